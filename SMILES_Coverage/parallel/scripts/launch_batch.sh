@@ -0,0 +1,37 @@
+#!/bin/bash
+
+#########################################################################
+## Input validation
+#########################################################################
+function print_usage {
+  >&2 echo ""
+  >&2 echo "USAGE: /path/to/launch_batch.sh /path/to/main /path/to/manifest.txt N"
+  >&2 echo ""
+  >&2 echo "The manifest lists one \"/path/to/input.smi /path/to/output.csv\" pair per line"
+  >&2 echo "N stands for the parallelism level"
+  >&2 echo ""
+  >&2 echo "Example:"
+  >&2 echo "./scripts/launch_batch.sh ./build/main ./manifest.txt 4"
+}
+if [ "$#" -ne "3" ]; then
+  >&2 echo "Error: expecting 3 parameters, got $#"
+  print_usage
+  exit -1
+fi
+application_filepath="$1"
+manifest_filepath="$2"
+parallelism_level="$3"
+for required_file in "$application_filepath" "$manifest_filepath"; do
+  if [ ! -s "$required_file" ]; then
+    >&2 echo "Error: file \"$required_file\" is empty or non-existent"
+    print_usage
+    exit -2
+  fi
+done
+if ! [[ $parallelism_level =~ ^[0-9]+$ ]] ; then
+  >&2 echo "Error: the parallelism level \"$parallelism_level\" is not an integer"
+  exit -3
+fi
+
+# launch the application (using MPI) on all the inputs of the manifest
+mpirun -np "$parallelism_level" "$application_filepath" --batch "$manifest_filepath"
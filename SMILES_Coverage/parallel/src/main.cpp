@@ -1,11 +1,23 @@
 #include <mpi.h>
 #include <algorithm>
+#include <array>
+#include <cmath>
 #include <cstdint>
 #include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+#include "chunk_pipeline.hpp"
 #include "mpi_error_check.hpp"
 
 #define MAX_LINE_LENGTH 1024
@@ -16,6 +28,23 @@ static constexpr size_t max_dictionary_size = 128;
 static_assert(max_pattern_len > 1, "The pattern must contain at least one character");
 static_assert(max_dictionary_size > 1, "The dictionary must contain at least one element");
 
+// in batch mode, inputs of at least this size are processed by all the ranks together, while smaller ones are
+// handed to a single rank
+static constexpr std::uintmax_t batch_large_file_bytes = 1 << 20;  // 1MB
+
+// in progressive mode, the database is sampled in blocks of this size; the ranking is not trusted before a
+// few blocks have been sampled and it must be stable for a few checkpoints before stopping
+static constexpr std::size_t progressive_block_size = 1 << 14;
+static constexpr std::size_t progressive_min_blocks = 8;
+static constexpr int progressive_stable_checkpoints = 3;
+static constexpr double progressive_z = 1.96;  // 95% confidence intervals
+static constexpr std::uint64_t progressive_seed = 42;
+
+// in streaming mode, the input is read in chunks of this size while the previous chunks are being counted
+static constexpr std::size_t stream_chunk_size = 1 << 20;  // 1MB
+static constexpr std::size_t stream_num_chunks = 8;
+static_assert(max_pattern_len < 8, "The ngram and its size must fit in a 64 bit key");
+
 // global variables that hold the message tags
 const int tag_size =
     0;  // tag to send the num of lines, such that each process can allocate a recvbuf of the right size
@@ -25,8 +54,10 @@ struct mpi_context_type {
   int rank;
   int size;
 
-  mpi_context_type() {
-    MPI_Comm_dup(MPI_COMM_WORLD, &comm);
+  mpi_context_type() : mpi_context_type(MPI_COMM_WORLD) {}
+
+  explicit mpi_context_type(MPI_Comm parent) {
+    MPI_Comm_dup(parent, &comm);
     MPI_Comm_rank(comm, &rank);
     MPI_Comm_size(comm, &size);
   }
@@ -98,28 +129,63 @@ size_t count_coverage(const std::string &dataset, const char *ngram) {
   return counter * ngram_size;
 }
 
-int main([[maybe_unused]] int argc, [[maybe_unused]] char *argv[]) {
-  // initialize MPI
-  int provided_thread_level;
-  int rc_init = MPI_Init_thread(&argc, &argv, MPI_THREAD_SINGLE, &provided_thread_level);
-  exit_on_fail(rc_init);
-  if (provided_thread_level < MPI_THREAD_SINGLE) {
-    std::cerr << "The MPI implementation does not support multiple threads" << std::endl;
-    return EXIT_FAILURE;
-  }
+// occurrences of an ngram counted so far while streaming
+struct ngram_counter {
+  std::size_t count = 0;
+  std::size_t last_start = std::string::npos;  // position of the last counted occurrence
+};
+using ngram_counters = std::unordered_map<std::uint64_t, ngram_counter>;
 
-  double start_time, end_time;
+// pack the characters of the ngram and its size in a single key
+std::uint64_t ngram_key(const char *ngram, std::size_t ngram_size) {
+  std::uint64_t key = std::uint64_t{ngram_size} << 56;
+  for (std::size_t i = 0; i < ngram_size; ++i) {
+    key |= std::uint64_t{static_cast<unsigned char>(ngram[i])} << (8 * i);
+  }
+  return key;
+}
 
-  // get the MPI context
-  mpi_context_type mpi_context = mpi_context_type();
+// each streaming worker counts only the ngrams it owns, so that the occurrences of an ngram are seen in order
+std::size_t ngram_owner(std::uint64_t key, std::size_t num_owners) {
+  return ((key * 0x9E3779B97F4A7C15ull) >> 32) % num_owners;
+}
 
-  // create and commit the MPI_Datatype for the string
-  MPI_Datatype mpi_string_type;
-  int rc_type = MPI_Type_contiguous(max_pattern_len + 1, MPI_CHAR, &mpi_string_type);
-  exit_on_fail(rc_type);
-  rc_type = MPI_Type_commit(&mpi_string_type);
-  exit_on_fail(rc_type);
+/**
+ * count the non-overlapping occurrences (as in count_coverage) of the ngrams owned by this worker in all the
+ * chunks of the pipeline, with a separate counter for each input
+ */
+void count_stream(chunk_pipeline &pipeline, std::size_t owner, std::size_t num_owners,
+                  std::vector<ngram_counters> &counters) {
+  for (std::size_t sequence = 0;; ++sequence) {
+    const chunk *current = pipeline.wait(sequence);
+    if (current == nullptr) break;
+
+    const auto &data = current->data;
+    for (std::size_t index = 0; index < data.size(); ++index) {
+      const auto position = current->position + index;
+      std::uint64_t key = 0;
+      for (std::size_t ngram_size = 1; ngram_size <= max_pattern_len && index + ngram_size <= data.size();
+           ++ngram_size) {
+        key |= std::uint64_t{static_cast<unsigned char>(data[index + ngram_size - 1])} << (8 * (ngram_size - 1));
+        if (index + ngram_size <= current->carry) continue;  // already counted with the previous chunk
+
+        const auto sized_key = key | (std::uint64_t{ngram_size} << 56);
+        if (ngram_owner(sized_key, num_owners) != owner) continue;
+        auto &counter = counters[current->source][sized_key];
+        if (counter.last_start != std::string::npos && position < counter.last_start + ngram_size) continue;
+        counter.last_start = position;
+        ++counter.count;
+      }
+    }
+    pipeline.release(sequence);
+  }
+}
 
+/**
+ * read the molecules from input on the master process and broadcast them, as a single string, to all the
+ * processes of the context
+ */
+std::string broadcast_database(const mpi_context_type &mpi_context, std::istream &input) {
   // This is the vector of lines that will be read from the standard input by the master process
   std::vector<std::string> lines;
 
@@ -131,12 +197,10 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char *argv[]) {
   database.reserve(209715200);
 
   if (mpi_context.rank == 0) {
-    start_time = MPI_Wtime();
-
     // Read The input from the standard input
     std::cerr << "Reading the molecules from the standard input ..." << std::endl;
 
-    for (std::string line; std::getline(std::cin, line); /* automatically handled */) {
+    for (std::string line; std::getline(input, line); /* automatically handled */) {
       lines.push_back(std::move(line));
     }
 
@@ -159,6 +223,9 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char *argv[]) {
     int rc_recv = MPI_Recv(&num_chars, 1, MPI_INT, 0, tag_size, mpi_context.comm, MPI_STATUS_IGNORE);
     exit_on_fail(rc_recv);
     fprintf(stderr, "Process %d knows that the database has %d chars\n", mpi_context.rank, num_chars);
+
+    // make room for the broadcast data, the reserved capacity alone is not part of the string
+    database.resize(num_chars);
   }
 
   // Master broadcast the database to the other processes
@@ -170,12 +237,18 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char *argv[]) {
   int rc_barrier = MPI_Barrier(mpi_context.comm);
   exit_on_fail(rc_barrier);  // here all processes have the same lines vector
 
-  // Now recvbuf is ready to be used and contains the lines to be processed
+  return database;
+}
+
+/**
+ * compute the alphabet of the database, all the processes obtain the same characters in the same order
+ */
+std::vector<char> compute_alphabet(const std::string &database) {
   std::unordered_set<char> alphabet_builder;
 
   // compute the alphabet
-  for (int i = 0; i < num_chars; ++i) {
-    alphabet_builder.insert(database[i]);
+  for (const auto character : database) {
+    alphabet_builder.insert(character);
   }
 
   // put the alphabet in a container with random access capabilities
@@ -183,24 +256,20 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char *argv[]) {
   alphabet_builder.reserve(alphabet_builder.size());
   std::for_each(std::begin(alphabet_builder), std::end(alphabet_builder),
                 [&alphabet](const auto character) { alphabet.push_back(character); });
+  return alphabet;
+}
 
-  rc_barrier = MPI_Barrier(mpi_context.comm);
-  exit_on_fail(rc_barrier);
-
-  fprintf(stderr, "Process %d alphabet size: %zu\n", mpi_context.rank, alphabet.size());
-
-  // declare the dictionary that holds all the ngrams with the greatest coverage of the dictionary
-  dictionary result;
-
-  std::size_t total_words;
-
-  std::size_t start_index[max_pattern_len];
-  std::size_t end_index[max_pattern_len];
+/**
+ * split the words of each ngram size among the processes, the i-th word of size n is composed of the
+ * characters of its index written in base alphabet_size (least significant digit first)
+ */
+void split_words(const mpi_context_type &mpi_context, std::size_t alphabet_size,
+                 std::size_t start_index[max_pattern_len], std::size_t end_index[max_pattern_len]) {
   if (mpi_context.rank == 0) {
     // precompute the number of permutations according to the number of characters
-    auto permutations = std::vector(max_pattern_len, alphabet.size());
+    auto permutations = std::vector(max_pattern_len, alphabet_size);
     for (std::size_t i{1}; i < permutations.size(); ++i) {
-      permutations[i] = alphabet.size() * permutations[i - std::size_t{1}];
+      permutations[i] = alphabet_size * permutations[i - std::size_t{1}];
     }
 
     // For each ngram size compute start and end index of the words to be processed
@@ -226,19 +295,19 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char *argv[]) {
           ++end;
         }
         offset = end;
-        int rc_send = MPI_Send(&start, 1, MPI_INT, i, tag_size, mpi_context.comm);
+        int rc_send = MPI_Send(&start, 1, MPI_UNSIGNED_LONG, i, tag_size, mpi_context.comm);
         exit_on_fail(rc_send);
-        rc_send = MPI_Send(&end, 1, MPI_INT, i, tag_size, mpi_context.comm);
+        rc_send = MPI_Send(&end, 1, MPI_UNSIGNED_LONG, i, tag_size, mpi_context.comm);
         exit_on_fail(rc_send);
       }
     }
   } else {
     for (std::size_t ngram_size{1}; ngram_size <= max_pattern_len; ++ngram_size) {
-      int rc_recv = MPI_Recv(&start_index[ngram_size - 1], 1, MPI_INT, 0, tag_size, mpi_context.comm,
+      int rc_recv = MPI_Recv(&start_index[ngram_size - 1], 1, MPI_UNSIGNED_LONG, 0, tag_size, mpi_context.comm,
                              MPI_STATUS_IGNORE);
       exit_on_fail(rc_recv);
-      rc_recv =
-          MPI_Recv(&end_index[ngram_size - 1], 1, MPI_INT, 0, tag_size, mpi_context.comm, MPI_STATUS_IGNORE);
+      rc_recv = MPI_Recv(&end_index[ngram_size - 1], 1, MPI_UNSIGNED_LONG, 0, tag_size, mpi_context.comm,
+                         MPI_STATUS_IGNORE);
       exit_on_fail(rc_recv);
     }
   }
@@ -249,55 +318,45 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char *argv[]) {
           start_index[1], end_index[1]);
   fprintf(stderr, "Process %d computing from %zu(inc) to %zu(exc) words of ngram_size 3\n", mpi_context.rank,
           start_index[2], end_index[2]);
+}
 
-  // Now each process has the number of words to be processed, we can split the work
-  for (std::size_t ngram_size = 1; ngram_size <= max_pattern_len; ++ngram_size) {
-    for (std::size_t word_index = start_index[ngram_size - 1]; word_index < end_index[ngram_size - 1];
-         ++word_index) {
-      // compose the ngram
-      word current_word;
-      memset(current_word.ngram, '\0', max_pattern_len + 1);
-      for (std::size_t character_index{0}, remaining_size = word_index; character_index < ngram_size;
-           ++character_index, remaining_size /= alphabet.size()) {
-        current_word.ngram[character_index] = alphabet[remaining_size % alphabet.size()];
-      }
-      current_word.size = ngram_size;
-
-      // evaluate the coverage and add the word to the dictionary
-      current_word.coverage = count_coverage(database.c_str(), current_word.ngram);
-      result.add_word(current_word);
-    }
+/**
+ * compose the word with the given index among the ones of size ngram_size
+ */
+word compose_word(std::size_t word_index, std::size_t ngram_size, const std::vector<char> &alphabet) {
+  word current_word;
+  memset(current_word.ngram, '\0', max_pattern_len + 1);
+  for (std::size_t character_index{0}, remaining_size = word_index; character_index < ngram_size;
+       ++character_index, remaining_size /= alphabet.size()) {
+    current_word.ngram[character_index] = alphabet[remaining_size % alphabet.size()];
   }
+  current_word.size = ngram_size;
+  return current_word;
+}
 
-  int rc_reduce_barrier = MPI_Barrier(mpi_context.comm);
-  exit_on_fail(rc_reduce_barrier);
-
-  fprintf(stderr, "Process %d finished computing, dict size: %zu\n", mpi_context.rank, result.data.size());
-  // Now each process has a dictionary with the ngrams with the greatest coverage, we need to reduce them to
-  // the master process summing the coverage of the same ngrams and then the master process will compute the
-  // final dictionary
-
+/**
+ * gather the dictionaries of all the processes on the master process, where they are reduced to the final
+ * dictionary (the other processes get an empty one)
+ */
+dictionary gather_dictionary(const mpi_context_type &mpi_context, MPI_Datatype mpi_string_type,
+                             const dictionary &result) {
   // Gather the vector of words of each process dictionary into a vector of dictionaries on the master process
   // Padding the vector of words with empty words.
 
-  // Collect the maximum size and the sum of the sizes of the dictionaries
-
+  // Collect the maximum size of the dictionaries
   int size_max;
-  int size_sum;
   int size = result.data.size();
 
   int rc_reduce = MPI_Allreduce(&size, &size_max, 1, MPI_INT, MPI_MAX, mpi_context.comm);
   exit_on_fail(rc_reduce);
-  rc_reduce = MPI_Allreduce(&size, &size_sum, 1, MPI_INT, MPI_SUM, mpi_context.comm);
-  exit_on_fail(rc_reduce);
 
-  rc_barrier = MPI_Barrier(mpi_context.comm);
+  int rc_barrier = MPI_Barrier(mpi_context.comm);
   exit_on_fail(rc_barrier);
 
   std::size_t partial_coverages[size_max];
 
   int i;
-  for (i = 0; i < result.data.size(); ++i) {
+  for (i = 0; i < size; ++i) {
     partial_coverages[i] = result.data[i].coverage;
   }
   for (; i < size_max; ++i) {  // padding
@@ -306,16 +365,17 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char *argv[]) {
 
   char partial_ngrams[size_max][max_pattern_len + 1];
 
-  for (i = 0; i < result.data.size(); ++i) {
+  for (i = 0; i < size; ++i) {
     strcpy(partial_ngrams[i], result.data[i].ngram);
   }
   for (; i < size_max; ++i) {  // padding
     memset(partial_ngrams[i], '\0', max_pattern_len + 1);
   }
 
-  // recvbuf will contain the gathered coverages and ngrams
-  std::size_t coverages[size_sum];
-  char ngrams[size_sum][max_pattern_len + 1];
+  // recvbuf will contain the gathered coverages and ngrams, including the padding of every process
+  const int size_recv = size_max * mpi_context.size;
+  std::size_t coverages[size_recv];
+  char ngrams[size_recv][max_pattern_len + 1];
 
   rc_barrier = MPI_Barrier(mpi_context.comm);
   exit_on_fail(rc_barrier);
@@ -331,13 +391,12 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char *argv[]) {
   rc_barrier = MPI_Barrier(mpi_context.comm);
   exit_on_fail(rc_barrier);
 
-  if (mpi_context.rank == 0) {
-    fprintf(stderr, "Process %d writing final dictionary\n", mpi_context.rank);
+  // declare the final dictionary that will be used to store the reduced dictionaries
+  dictionary final_dict;
 
-    // declare the final dictionary that will be used to store the reduced dictionaries
-    dictionary final_dict;
-
-    for (int i = 0; i < size_sum; ++i) {
+  if (mpi_context.rank == 0) {
+    for (int i = 0; i < size_recv; ++i) {
+      if (ngrams[i][0] == '\0') continue;  // padding
       word current_word;
       memset(current_word.ngram, '\0', max_pattern_len + 1);
       strcpy(current_word.ngram, ngrams[i]);
@@ -345,12 +404,66 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char *argv[]) {
       current_word.coverage = coverages[i];
       final_dict.add_word(current_word);
     }
+  }
+  return final_dict;
+}
+
+/**
+ * compute the ngram coverage of the molecules read from input (only the rank 0 of the context reads it) and
+ * write the final dictionary on output (only the rank 0 of the context writes it)
+ */
+void compute_coverage(const mpi_context_type &mpi_context, MPI_Datatype mpi_string_type, std::istream &input,
+                      std::ostream &output) {
+  double start_time, end_time;
+  if (mpi_context.rank == 0) {
+    start_time = MPI_Wtime();
+  }
+
+  const auto database = broadcast_database(mpi_context, input);
+  const auto alphabet = compute_alphabet(database);
+
+  int rc_barrier = MPI_Barrier(mpi_context.comm);
+  exit_on_fail(rc_barrier);
+
+  fprintf(stderr, "Process %d alphabet size: %zu\n", mpi_context.rank, alphabet.size());
+
+  // declare the dictionary that holds all the ngrams with the greatest coverage of the dictionary
+  dictionary result;
+
+  std::size_t start_index[max_pattern_len];
+  std::size_t end_index[max_pattern_len];
+  split_words(mpi_context, alphabet.size(), start_index, end_index);
+
+  // Now each process has the number of words to be processed, we can split the work
+  for (std::size_t ngram_size = 1; ngram_size <= max_pattern_len; ++ngram_size) {
+    for (std::size_t word_index = start_index[ngram_size - 1]; word_index < end_index[ngram_size - 1];
+         ++word_index) {
+      // compose the ngram
+      word current_word = compose_word(word_index, ngram_size, alphabet);
+
+      // evaluate the coverage and add the word to the dictionary
+      current_word.coverage = count_coverage(database, current_word.ngram);
+      result.add_word(current_word);
+    }
+  }
+
+  int rc_reduce_barrier = MPI_Barrier(mpi_context.comm);
+  exit_on_fail(rc_reduce_barrier);
+
+  fprintf(stderr, "Process %d finished computing, dict size: %zu\n", mpi_context.rank, result.data.size());
+  // Now each process has a dictionary with the ngrams with the greatest coverage, we need to reduce them to
+  // the master process summing the coverage of the same ngrams and then the master process will compute the
+  // final dictionary
+  auto final_dict = gather_dictionary(mpi_context, mpi_string_type, result);
+
+  if (mpi_context.rank == 0) {
+    fprintf(stderr, "Process %d writing final dictionary\n", mpi_context.rank);
 
     // generate the final dictionary
     // NOTE: we sort it for pretty-printing
-    std::cout << "NGRAM COVERAGE" << std::endl;
+    output << "NGRAM COVERAGE" << std::endl;
     std::sort(std::begin(final_dict.data), std::end(final_dict.data), word_coverage_gt_comparator{});
-    final_dict.write(std::cout);
+    final_dict.write(output);
 
     end_time = MPI_Wtime();
     std::cerr << "Time of execution with " << mpi_context.size << " processes: " << end_time - start_time
@@ -360,6 +473,677 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char *argv[]) {
   // Put a barrier to make sure that all processes have finished
   rc_barrier = MPI_Barrier(mpi_context.comm);
   exit_on_fail(rc_barrier);
+}
+
+/**
+ * read the inputs on the master, one after the other, and broadcast their chunks to the pipeline of every
+ * process (the ngrams never cross the boundary between two inputs). Return the alphabet of all the inputs,
+ * in order of appearance, and on the master, if requested, the number of characters of each input
+ */
+std::vector<char> stream_inputs(const mpi_context_type &mpi_context, chunk_pipeline &pipeline,
+                                const std::vector<std::istream *> &inputs,
+                                std::vector<unsigned long> *num_chars = nullptr) {
+  // NOTE: the master figures out the alphabet while reading, in the same order of the whole database
+  std::unordered_set<char> alphabet_builder;
+  std::array<bool, 256> seen{};
+  for (unsigned long source = 0; source < inputs.size(); ++source) {
+    for (bool first_chunk = true;; first_chunk = false) {
+      const auto carry_size = first_chunk ? 0 : max_pattern_len - 1;
+      auto &next = pipeline.acquire();
+      unsigned long new_chars = 0;
+      if (mpi_context.rank == 0 &&
+          read_chunk(*inputs[source], pipeline.last_published(), next, stream_chunk_size, carry_size)) {
+        new_chars = next.data.size() - next.carry;
+        for (std::size_t i = next.carry; i < next.data.size(); ++i) {
+          if (!seen[static_cast<unsigned char>(next.data[i])]) {
+            seen[static_cast<unsigned char>(next.data[i])] = true;
+            alphabet_builder.emplace(next.data[i]);
+          }
+        }
+        if (num_chars != nullptr) (*num_chars)[source] += new_chars;
+      }
+      int rc_bcast = MPI_Bcast(&new_chars, 1, MPI_UNSIGNED_LONG, 0, mpi_context.comm);
+      exit_on_fail(rc_bcast);
+      if (new_chars == 0) break;
+
+      if (mpi_context.rank != 0) {
+        continue_chunk(pipeline.last_published(), next, new_chars, carry_size);
+      }
+      rc_bcast = MPI_Bcast(&next.data[next.carry], new_chars, MPI_CHAR, 0, mpi_context.comm);
+      exit_on_fail(rc_bcast);
+      next.source = source;
+      pipeline.publish();
+    }
+  }
+  pipeline.close();
+
+  // share the alphabet of the master
+  std::vector<char> alphabet(std::begin(alphabet_builder), std::end(alphabet_builder));
+  int alphabet_size = alphabet.size();
+  int rc_bcast = MPI_Bcast(&alphabet_size, 1, MPI_INT, 0, mpi_context.comm);
+  exit_on_fail(rc_bcast);
+  alphabet.resize(alphabet_size);
+  rc_bcast = MPI_Bcast(alphabet.data(), alphabet_size, MPI_CHAR, 0, mpi_context.comm);
+  exit_on_fail(rc_bcast);
+  return alphabet;
+}
+
+/**
+ * compute the ngram coverage while the master is still reading the molecules: every chunk read by the master
+ * is broadcast to all the processes, where num_threads workers count the ngrams they own. Each ngram is owned
+ * by a single worker of a single process, so the dictionaries are gathered as in the exact computation
+ */
+void compute_streaming_coverage(const mpi_context_type &mpi_context, MPI_Datatype mpi_string_type,
+                                std::istream &input, std::ostream &output, std::size_t num_threads) {
+  double start_time = 0.0, end_time;
+  if (mpi_context.rank == 0) {
+    start_time = MPI_Wtime();
+    std::cerr << "Streaming the molecules from the standard input ..." << std::endl;
+  }
+
+  const std::size_t num_owners = mpi_context.size * num_threads;
+  chunk_pipeline pipeline(stream_num_chunks, num_threads);
+  std::vector<std::vector<ngram_counters>> counters(num_threads, std::vector<ngram_counters>(1));
+  std::vector<std::thread> workers;
+  for (std::size_t thread = 0; thread < num_threads; ++thread) {
+    workers.emplace_back(count_stream, std::ref(pipeline), mpi_context.rank * num_threads + thread, num_owners,
+                         std::ref(counters[thread]));
+  }
+
+  const auto alphabet = stream_inputs(mpi_context, pipeline, {&input});
+  for (auto &worker : workers) {
+    worker.join();
+  }
+
+  fprintf(stderr, "Process %d alphabet size: %zu\n", mpi_context.rank, alphabet.size());
+
+  // every process adds to its dictionary the words owned by its workers
+  dictionary result;
+  std::size_t num_words = 1;
+  for (std::size_t ngram_size = 1; ngram_size <= max_pattern_len; ++ngram_size) {
+    num_words *= alphabet.size();
+    for (std::size_t word_index = 0; word_index < num_words; ++word_index) {
+      word current_word = compose_word(word_index, ngram_size, alphabet);
+      const auto key = ngram_key(current_word.ngram, ngram_size);
+      const auto owner = ngram_owner(key, num_owners);
+      if (owner / num_threads != static_cast<std::size_t>(mpi_context.rank)) continue;
+
+      const auto &owner_counters = counters[owner % num_threads][0];
+      const auto counter = owner_counters.find(key);
+      current_word.coverage = counter == std::end(owner_counters) ? 0 : counter->second.count * ngram_size;
+      result.add_word(current_word);
+    }
+  }
+
+  fprintf(stderr, "Process %d finished computing, dict size: %zu\n", mpi_context.rank, result.data.size());
+  auto final_dict = gather_dictionary(mpi_context, mpi_string_type, result);
+
+  if (mpi_context.rank == 0) {
+    fprintf(stderr, "Process %d writing final dictionary\n", mpi_context.rank);
+
+    // generate the final dictionary
+    // NOTE: we sort it for pretty-printing
+    output << "NGRAM COVERAGE" << std::endl;
+    std::sort(std::begin(final_dict.data), std::end(final_dict.data), word_coverage_gt_comparator{});
+    final_dict.write(output);
+
+    end_time = MPI_Wtime();
+    std::cerr << "Time of execution with " << mpi_context.size << " processes: " << end_time - start_time
+              << std::endl;
+  }
+
+  int rc_barrier = MPI_Barrier(mpi_context.comm);
+  exit_on_fail(rc_barrier);
+}
+
+// how the coverage of an ngram in an input is compared with its coverage in the other inputs
+enum class differential_metric { difference, ratio };
+
+/**
+ * score of an ngram for the target input, given its coverage in every input: the difference between the
+ * fraction of the target and of the other inputs that it covers, or the ratio between them (smoothed, so that
+ * ngrams missing from one side are still ranked)
+ */
+double differential_score(differential_metric metric, const unsigned long *coverages,
+                          const std::vector<unsigned long> &num_chars, std::size_t target) {
+  double target_coverage = coverages[target];
+  double target_chars = num_chars[target];
+  double other_coverage = 0.0;
+  double other_chars = 0.0;
+  for (std::size_t input = 0; input < num_chars.size(); ++input) {
+    if (input == target) continue;
+    other_coverage += coverages[input];
+    other_chars += num_chars[input];
+  }
+  if (metric == differential_metric::ratio) {
+    return ((target_coverage + 1.0) / (target_chars + 1.0)) / ((other_coverage + 1.0) / (other_chars + 1.0));
+  }
+  return (0.0 < target_chars ? target_coverage / target_chars : 0.0) -
+         (0.0 < other_chars ? other_coverage / other_chars : 0.0);
+}
+
+/**
+ * count the ngrams of several labelled inputs in a single streaming pass, with a counter for each input, and
+ * write for each input the max_dictionary_size ngrams that are most enriched in it with respect to all the
+ * other inputs together. Each ngram is owned by a single process, which knows its coverage in every input, so
+ * only the best candidates of each process are gathered
+ */
+void compute_differential_coverage(const mpi_context_type &mpi_context, MPI_Datatype mpi_string_type,
+                                   const std::vector<std::string> &labels, const std::vector<std::string> &paths,
+                                   differential_metric metric, std::ostream &output) {
+  double start_time = 0.0, end_time;
+  const auto num_inputs = labels.size();
+  std::vector<std::ifstream> files(num_inputs);
+  std::vector<std::istream *> inputs(num_inputs, nullptr);
+  if (mpi_context.rank == 0) {
+    start_time = MPI_Wtime();
+    for (std::size_t input = 0; input < num_inputs; ++input) {
+      files[input].open(paths[input]);
+      if (!files[input]) {
+        std::cerr << "Unable to open " << paths[input] << ", " << labels[input] << " will be empty" << std::endl;
+      }
+      inputs[input] = &files[input];
+    }
+    std::cerr << "Streaming the molecules of " << num_inputs << " inputs ..." << std::endl;
+  }
+
+  const std::size_t num_threads = 1;
+  const std::size_t num_owners = mpi_context.size * num_threads;
+  chunk_pipeline pipeline(stream_num_chunks, num_threads);
+  std::vector<std::vector<ngram_counters>> counters(num_threads, std::vector<ngram_counters>(num_inputs));
+  std::vector<std::thread> workers;
+  for (std::size_t thread = 0; thread < num_threads; ++thread) {
+    workers.emplace_back(count_stream, std::ref(pipeline), mpi_context.rank * num_threads + thread, num_owners,
+                         std::ref(counters[thread]));
+  }
+
+  std::vector<unsigned long> num_chars(num_inputs, 0);
+  const auto alphabet = stream_inputs(mpi_context, pipeline, inputs, &num_chars);
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  int rc_bcast = MPI_Bcast(num_chars.data(), num_inputs, MPI_UNSIGNED_LONG, 0, mpi_context.comm);
+  exit_on_fail(rc_bcast);
+
+  fprintf(stderr, "Process %d alphabet size: %zu\n", mpi_context.rank, alphabet.size());
+
+  // collect the coverages of the owned words that appear in at least one input
+  std::vector<word> local_words;
+  std::vector<unsigned long> local_coverages;
+  std::size_t num_words = 1;
+  for (std::size_t ngram_size = 1; ngram_size <= max_pattern_len; ++ngram_size) {
+    num_words *= alphabet.size();
+    for (std::size_t word_index = 0; word_index < num_words; ++word_index) {
+      const word current_word = compose_word(word_index, ngram_size, alphabet);
+      const auto key = ngram_key(current_word.ngram, ngram_size);
+      const auto owner = ngram_owner(key, num_owners);
+      if (owner / num_threads != static_cast<std::size_t>(mpi_context.rank)) continue;
+
+      bool found = false;
+      for (const auto &input_counters : counters[owner % num_threads]) {
+        const auto counter = input_counters.find(key);
+        local_coverages.push_back(counter == std::end(input_counters) ? 0 : counter->second.count * ngram_size);
+        found = found || counter != std::end(input_counters);
+      }
+      if (found) {
+        local_words.push_back(current_word);
+      } else {
+        local_coverages.resize(local_coverages.size() - num_inputs);
+      }
+    }
+  }
+
+  // pick the best local candidates for each input, padded with empty words
+  const std::size_t top_k = max_dictionary_size;
+  const std::size_t num_candidates = num_inputs * top_k;
+  std::vector<char> partial_ngrams(num_candidates * (max_pattern_len + 1), '\0');
+  std::vector<double> partial_scores(num_candidates, 0.0);
+  std::vector<unsigned long> partial_coverages(num_candidates * num_inputs, 0);
+  std::vector<double> scores(local_words.size());
+  std::vector<std::size_t> ranking(local_words.size());
+  for (std::size_t target = 0; target < num_inputs; ++target) {
+    for (std::size_t i = 0; i < local_words.size(); ++i) {
+      scores[i] = differential_score(metric, &local_coverages[i * num_inputs], num_chars, target);
+    }
+    const auto local_top_size = std::min(top_k, local_words.size());
+    std::iota(std::begin(ranking), std::end(ranking), 0);
+    std::partial_sort(std::begin(ranking), std::begin(ranking) + local_top_size, std::end(ranking),
+                      [&scores](const auto i, const auto j) { return scores[i] > scores[j]; });
+    for (std::size_t k = 0; k < local_top_size; ++k) {
+      const auto candidate = target * top_k + k;
+      const auto i = ranking[k];
+      strcpy(&partial_ngrams[candidate * (max_pattern_len + 1)], local_words[i].ngram);
+      partial_scores[candidate] = scores[i];
+      std::copy_n(&local_coverages[i * num_inputs], num_inputs, &partial_coverages[candidate * num_inputs]);
+    }
+  }
+
+  const std::size_t size_recv = num_candidates * mpi_context.size;
+  std::vector<char> ngrams(mpi_context.rank == 0 ? size_recv * (max_pattern_len + 1) : 0);
+  std::vector<double> candidate_scores(mpi_context.rank == 0 ? size_recv : 0);
+  std::vector<unsigned long> coverages(mpi_context.rank == 0 ? size_recv * num_inputs : 0);
+  int rc_gather = MPI_Gather(partial_ngrams.data(), num_candidates, mpi_string_type, ngrams.data(), num_candidates,
+                             mpi_string_type, 0, mpi_context.comm);
+  exit_on_fail(rc_gather);
+  rc_gather = MPI_Gather(partial_scores.data(), num_candidates, MPI_DOUBLE, candidate_scores.data(), num_candidates,
+                         MPI_DOUBLE, 0, mpi_context.comm);
+  exit_on_fail(rc_gather);
+  rc_gather = MPI_Gather(partial_coverages.data(), num_candidates * num_inputs, MPI_UNSIGNED_LONG, coverages.data(),
+                         num_candidates * num_inputs, MPI_UNSIGNED_LONG, 0, mpi_context.comm);
+  exit_on_fail(rc_gather);
+
+  if (mpi_context.rank == 0) {
+    fprintf(stderr, "Process %d writing the differential dictionaries\n", mpi_context.rank);
+
+    const auto ngram_of = [&ngrams](const std::size_t i) { return &ngrams[i * (max_pattern_len + 1)]; };
+    std::vector<std::size_t> final_ranking;
+    for (std::size_t target = 0; target < num_inputs; ++target) {
+      // the candidates of the target are in the same slots of every process
+      final_ranking.clear();
+      for (int rank = 0; rank < mpi_context.size; ++rank) {
+        for (std::size_t k = 0; k < top_k; ++k) {
+          const auto i = rank * num_candidates + target * top_k + k;
+          if (ngram_of(i)[0] != '\0') final_ranking.push_back(i);
+        }
+      }
+      std::stable_sort(std::begin(final_ranking), std::end(final_ranking), [&candidate_scores](auto i, auto j) {
+        return candidate_scores[i] > candidate_scores[j];
+      });
+      final_ranking.resize(std::min(top_k, final_ranking.size()));
+
+      output << "ENRICHED IN " << labels[target] << std::endl;
+      output << "NGRAM " << (metric == differential_metric::ratio ? "RATIO" : "DIFFERENCE");
+      for (const auto &label : labels) {
+        output << ' ' << label;
+      }
+      output << std::endl;
+      for (const auto i : final_ranking) {
+        output << ngram_of(i) << ' ' << candidate_scores[i];
+        for (std::size_t input = 0; input < num_inputs; ++input) {
+          output << ' ' << coverages[i * num_inputs + input];
+        }
+        output << std::endl;
+      }
+    }
+    output << std::flush;
+
+    end_time = MPI_Wtime();
+    std::cerr << "Time of execution with " << mpi_context.size << " processes: " << end_time - start_time
+              << std::endl;
+  }
+
+  int rc_barrier = MPI_Barrier(mpi_context.comm);
+  exit_on_fail(rc_barrier);
+}
+
+/**
+ * estimate the ngram coverage from blocks of the database sampled in random order (without replacement) and
+ * publish on the standard error the current top_k words, with the confidence interval of their coverage,
+ * after each block. The sampling stops as soon as the ranking of the top_k words did not change for a few
+ * checkpoints and every confidence interval is narrower than tolerance (relative to its estimate)
+ */
+void compute_progressive_coverage(const mpi_context_type &mpi_context, MPI_Datatype mpi_string_type,
+                                  std::istream &input, std::ostream &output, double tolerance,
+                                  std::size_t top_k) {
+  double start_time = 0.0, end_time;
+  if (mpi_context.rank == 0) {
+    start_time = MPI_Wtime();
+  }
+
+  const auto database = broadcast_database(mpi_context, input);
+  const auto alphabet = compute_alphabet(database);
+
+  // each process keeps counting the words of its own range, as in the exact computation
+  std::size_t start_index[max_pattern_len];
+  std::size_t end_index[max_pattern_len];
+  split_words(mpi_context, alphabet.size(), start_index, end_index);
+
+  // map each character to its position in the alphabet
+  std::array<std::size_t, 256> character_index{};
+  for (std::size_t i = 0; i < alphabet.size(); ++i) {
+    character_index[static_cast<unsigned char>(alphabet[i])] = i;
+  }
+
+  // the counters of the local words are stored contiguously, one ngram size after the other
+  std::size_t local_offset[max_pattern_len + 1];
+  local_offset[0] = 0;
+  for (std::size_t ngram_size = 1; ngram_size <= max_pattern_len; ++ngram_size) {
+    local_offset[ngram_size] =
+        local_offset[ngram_size - 1] + end_index[ngram_size - 1] - start_index[ngram_size - 1];
+  }
+  const auto num_local_words = local_offset[max_pattern_len];
+  std::vector<std::size_t> block_counts(num_local_words, 0);  // occurrences in the current block
+  std::vector<std::size_t> touched_words;                     // words with a non-zero block count
+  std::vector<double> sum_counts(num_local_words, 0.0);       // sum of the block counts
+  std::vector<double> sum_squared_counts(num_local_words, 0.0);
+  std::vector<std::size_t> last_start(num_local_words, std::string::npos);  // last counted occurrence
+
+  // the master decides the order in which the blocks are sampled
+  const std::size_t num_blocks = (database.size() + progressive_block_size - 1) / progressive_block_size;
+  std::vector<unsigned long> block_order(num_blocks);
+  if (mpi_context.rank == 0) {
+    std::iota(std::begin(block_order), std::end(block_order), 0);
+    std::shuffle(std::begin(block_order), std::end(block_order), std::mt19937_64{progressive_seed});
+  }
+  int rc_bcast = MPI_Bcast(block_order.data(), num_blocks, MPI_UNSIGNED_LONG, 0, mpi_context.comm);
+  exit_on_fail(rc_bcast);
+
+  // the top_k local estimates are padded with empty words before being gathered on the master process
+  std::vector<std::size_t> local_top(num_local_words);
+  std::vector<char> partial_ngrams(top_k * (max_pattern_len + 1));
+  std::vector<double> partial_coverages(top_k);
+  std::vector<double> partial_half_widths(top_k);
+  const std::size_t size_recv = top_k * mpi_context.size;
+  std::vector<char> ngrams(size_recv * (max_pattern_len + 1));
+  std::vector<double> coverages(size_recv);
+  std::vector<double> half_widths(size_recv);
+  std::vector<std::size_t> ranking(size_recv);
+  std::vector<std::string> previous_top;
+  std::vector<std::string> current_top;
+  int stable_checkpoints = 0;
+
+  int stop = num_blocks == 0;
+  std::size_t sampled_blocks = 0;
+  while (!stop) {
+    // count the non-overlapping occurrences (as in count_coverage) of the local words starting in the block
+    const std::size_t block_start = block_order[sampled_blocks] * progressive_block_size;
+    const std::size_t block_end = std::min(block_start + progressive_block_size, database.size());
+    for (std::size_t position = block_start; position < block_end; ++position) {
+      std::size_t word_index = 0;
+      std::size_t weight = 1;
+      for (std::size_t ngram_size = 1; ngram_size <= max_pattern_len && position + ngram_size <= database.size();
+           ++ngram_size, weight *= alphabet.size()) {
+        word_index += character_index[static_cast<unsigned char>(database[position + ngram_size - 1])] * weight;
+        if (word_index < start_index[ngram_size - 1] || end_index[ngram_size - 1] <= word_index) continue;
+        const auto local_word = local_offset[ngram_size - 1] + word_index - start_index[ngram_size - 1];
+        if (last_start[local_word] <= position && position < last_start[local_word] + ngram_size) continue;
+        last_start[local_word] = position;
+        if (block_counts[local_word]++ == 0) touched_words.push_back(local_word);
+      }
+    }
+    for (const auto local_word : touched_words) {
+      const double count = block_counts[local_word];
+      sum_counts[local_word] += count;
+      sum_squared_counts[local_word] += count * count;
+      block_counts[local_word] = 0;
+    }
+    touched_words.clear();
+    ++sampled_blocks;
+
+    // estimate the total coverage of the best local words, with the finite population correction
+    const double sampled = sampled_blocks;
+    const double sampled_fraction = sampled / num_blocks;
+    const auto ngram_size_of = [&local_offset](const std::size_t local_word) {
+      return std::upper_bound(local_offset + 1, local_offset + max_pattern_len + 1, local_word) - local_offset;
+    };
+    const auto local_coverage = [&](const std::size_t local_word) {
+      return sum_counts[local_word] * ngram_size_of(local_word);
+    };
+    const std::size_t local_top_size = std::min(top_k, num_local_words);
+    std::iota(std::begin(local_top), std::end(local_top), 0);
+    std::partial_sort(std::begin(local_top), std::begin(local_top) + local_top_size, std::end(local_top),
+                      [&](const auto w1, const auto w2) { return local_coverage(w1) > local_coverage(w2); });
+    for (std::size_t i = 0; i < top_k; ++i) {
+      char *partial_ngram = &partial_ngrams[i * (max_pattern_len + 1)];
+      memset(partial_ngram, '\0', max_pattern_len + 1);
+      partial_coverages[i] = 0.0;
+      partial_half_widths[i] = 0.0;
+      if (local_top_size <= i) continue;  // padding
+
+      const auto local_word = local_top[i];
+      const auto ngram_size = ngram_size_of(local_word);
+      const auto word_index = start_index[ngram_size - 1] + local_word - local_offset[ngram_size - 1];
+      strcpy(partial_ngram, compose_word(word_index, ngram_size, alphabet).ngram);
+      partial_coverages[i] = num_blocks * sum_counts[local_word] / sampled * ngram_size;
+      partial_half_widths[i] = std::numeric_limits<double>::infinity();
+      if (1 < sampled_blocks) {
+        const double mean = sum_counts[local_word] / sampled;
+        const double variance =
+            std::max(0.0, (sum_squared_counts[local_word] - sampled * mean * mean) / (sampled - 1.0));
+        partial_half_widths[i] = progressive_z * num_blocks * ngram_size *
+                                 std::sqrt(variance / sampled * (1.0 - sampled_fraction));
+      }
+    }
+
+    int rc_gather = MPI_Gather(partial_coverages.data(), top_k, MPI_DOUBLE, coverages.data(), top_k, MPI_DOUBLE, 0,
+                               mpi_context.comm);
+    exit_on_fail(rc_gather);
+    rc_gather = MPI_Gather(partial_half_widths.data(), top_k, MPI_DOUBLE, half_widths.data(), top_k, MPI_DOUBLE, 0,
+                           mpi_context.comm);
+    exit_on_fail(rc_gather);
+    rc_gather = MPI_Gather(partial_ngrams.data(), top_k, mpi_string_type, ngrams.data(), top_k, mpi_string_type, 0,
+                           mpi_context.comm);
+    exit_on_fail(rc_gather);
+
+    if (mpi_context.rank == 0) {
+      // the words of different processes are disjoint, so the global top_k is the best of the local ones
+      const auto ngram_of = [&ngrams](const std::size_t i) { return &ngrams[i * (max_pattern_len + 1)]; };
+      ranking.clear();
+      for (std::size_t i = 0; i < size_recv; ++i) {
+        if (ngram_of(i)[0] != '\0') ranking.push_back(i);
+      }
+      std::stable_sort(std::begin(ranking), std::end(ranking),
+                       [&coverages](const auto i, const auto j) { return coverages[i] > coverages[j]; });
+      ranking.resize(std::min(top_k, ranking.size()));
+
+      std::cerr << "Top " << ranking.size() << " after sampling " << sampled_blocks << "/" << num_blocks
+                << " blocks:" << std::endl;
+      double worst_relative_width = 0.0;
+      current_top.clear();
+      for (const auto i : ranking) {
+        std::cerr << ngram_of(i) << ' ' << coverages[i] << " +- " << half_widths[i] << std::endl;
+        if (0.0 < coverages[i]) worst_relative_width = std::max(worst_relative_width, half_widths[i] / coverages[i]);
+        current_top.emplace_back(ngram_of(i));
+      }
+
+      stable_checkpoints = current_top == previous_top ? stable_checkpoints + 1 : 0;
+      std::swap(current_top, previous_top);
+      stop = sampled_blocks == num_blocks ||
+             (progressive_min_blocks <= sampled_blocks && progressive_stable_checkpoints <= stable_checkpoints &&
+              worst_relative_width <= tolerance);
+    }
+    rc_bcast = MPI_Bcast(&stop, 1, MPI_INT, 0, mpi_context.comm);
+    exit_on_fail(rc_bcast);
+  }
+
+  if (mpi_context.rank == 0) {
+    fprintf(stderr, "Process %d writing the estimated dictionary after sampling %zu/%zu blocks\n",
+            mpi_context.rank, sampled_blocks, num_blocks);
+
+    output << "NGRAM COVERAGE" << std::endl;
+    for (const auto i : ranking) {
+      output << &ngrams[i * (max_pattern_len + 1)] << ' ' << std::llround(coverages[i]) << std::endl;
+    }
+    output << std::flush;
+
+    end_time = MPI_Wtime();
+    std::cerr << "Time of execution with " << mpi_context.size << " processes: " << end_time - start_time
+              << std::endl;
+  }
+
+  int rc_barrier = MPI_Barrier(mpi_context.comm);
+  exit_on_fail(rc_barrier);
+}
+
+// a single entry of the batch manifest
+struct batch_job {
+  std::string input_path;
+  std::string output_path;
+};
+
+/**
+ * parse a manifest with one "<input.smi> <output.csv>" pair per line, empty lines and lines starting with '#'
+ * are ignored
+ */
+std::vector<batch_job> parse_manifest(const std::string &manifest) {
+  std::vector<batch_job> jobs;
+  std::istringstream manifest_stream(manifest);
+  for (std::string line; std::getline(manifest_stream, line); /* automatically handled */) {
+    std::istringstream line_stream(line);
+    batch_job job;
+    if (!(line_stream >> job.input_path) || job.input_path[0] == '#') continue;
+    if (!(line_stream >> job.output_path)) {
+      std::cerr << "Ignoring manifest line without an output file: " << line << std::endl;
+      continue;
+    }
+    jobs.push_back(std::move(job));
+  }
+  return jobs;
+}
+
+/**
+ * process every job of the manifest keeping the MPI context and the datatypes alive across them. Large inputs
+ * are processed by all the ranks together, one after the other, then each rank processes on its own the small
+ * inputs that have been assigned to it (largest first, to the least loaded rank). Returns false on every rank if
+ * the manifest cannot be opened, the jobs whose input or output cannot be opened are skipped
+ */
+bool run_batch(const mpi_context_type &mpi_context, MPI_Datatype mpi_string_type, const char *manifest_path) {
+  // tags for the owner of a job that are not ranks
+  const int owner_all = -1;
+  const int owner_none = -2;
+
+  // the master reads the manifest and computes the schedule, then it shares both with the other processes
+  std::string manifest;
+  int manifest_size = 0;
+  if (mpi_context.rank == 0) {
+    std::ifstream manifest_file(manifest_path);
+    if (!manifest_file) {
+      std::cerr << "Unable to open the manifest " << manifest_path << std::endl;
+      // a negative size tells the other processes to stop
+      manifest_size = -1;
+    } else {
+      std::ostringstream manifest_builder;
+      manifest_builder << manifest_file.rdbuf();
+      manifest = manifest_builder.str();
+      manifest_size = manifest.size();
+    }
+  }
+  int rc_bcast = MPI_Bcast(&manifest_size, 1, MPI_INT, 0, mpi_context.comm);
+  exit_on_fail(rc_bcast);
+  if (manifest_size < 0) return false;
+  manifest.resize(manifest_size);
+  rc_bcast = MPI_Bcast(&manifest[0], manifest_size, MPI_CHAR, 0, mpi_context.comm);
+  exit_on_fail(rc_bcast);
+
+  const auto jobs = parse_manifest(manifest);
+  std::vector<int> owners(jobs.size(), owner_all);
+
+  if (mpi_context.rank == 0) {
+    std::vector<std::uintmax_t> sizes(jobs.size(), 0);
+    std::vector<std::size_t> small_jobs;
+    for (std::size_t i = 0; i < jobs.size(); ++i) {
+      std::error_code error;
+      sizes[i] = std::filesystem::file_size(jobs[i].input_path, error);
+      if (error) {
+        std::cerr << "Skipping " << jobs[i].input_path << ": " << error.message() << std::endl;
+        owners[i] = owner_none;
+      } else if (!std::ofstream(jobs[i].output_path, std::ios::app)) {
+        // checked here, before the schedule, since the large inputs need all the ranks to agree on the skip
+        std::cerr << "Skipping " << jobs[i].input_path << ": unable to open the output " << jobs[i].output_path
+                  << std::endl;
+        owners[i] = owner_none;
+      } else if (sizes[i] < batch_large_file_bytes) {
+        small_jobs.push_back(i);
+      }
+    }
+
+    // longest processing time first: the biggest small files go to the least loaded rank
+    std::sort(std::begin(small_jobs), std::end(small_jobs),
+              [&sizes](const auto i, const auto j) { return sizes[i] > sizes[j]; });
+    std::vector<std::uintmax_t> loads(mpi_context.size, 0);
+    for (const auto i : small_jobs) {
+      const auto rank = std::min_element(std::begin(loads), std::end(loads)) - std::begin(loads);
+      owners[i] = rank;
+      loads[rank] += sizes[i];
+    }
+  }
+  rc_bcast = MPI_Bcast(owners.data(), owners.size(), MPI_INT, 0, mpi_context.comm);
+  exit_on_fail(rc_bcast);
+
+  fprintf(stderr, "Process %d scheduled %zu jobs\n", mpi_context.rank, jobs.size());
+
+  // the large inputs are split among all the ranks as in the single-input mode
+  for (std::size_t i = 0; i < jobs.size(); ++i) {
+    if (owners[i] != owner_all) continue;
+    std::ifstream input;
+    std::ofstream output;
+    if (mpi_context.rank == 0) {
+      input.open(jobs[i].input_path);
+      output.open(jobs[i].output_path);
+      std::cerr << "All processes computing " << jobs[i].input_path << std::endl;
+    }
+    compute_coverage(mpi_context, mpi_string_type, input, output);
+  }
+
+  // the small inputs are processed by their owner alone
+  auto self_context = mpi_context_type(MPI_COMM_SELF);
+  for (std::size_t i = 0; i < jobs.size(); ++i) {
+    if (owners[i] != mpi_context.rank) continue;
+    std::ifstream input(jobs[i].input_path);
+    std::ofstream output(jobs[i].output_path);
+    if (!input || !output) {
+      fprintf(stderr, "Process %d skipping %s: unable to open it or its output\n", mpi_context.rank,
+              jobs[i].input_path.c_str());
+      continue;
+    }
+    fprintf(stderr, "Process %d computing %s\n", mpi_context.rank, jobs[i].input_path.c_str());
+    compute_coverage(self_context, mpi_string_type, input, output);
+  }
+
+  int rc_comm_free = MPI_Comm_free(&self_context.comm);
+  exit_on_fail(rc_comm_free);
+
+  int rc_barrier = MPI_Barrier(mpi_context.comm);
+  exit_on_fail(rc_barrier);
+  return true;
+}
+
+int main([[maybe_unused]] int argc, [[maybe_unused]] char *argv[]) {
+  // initialize MPI
+  int provided_thread_level;
+  // NOTE: the streaming workers never call MPI, only the main thread does
+  int rc_init = MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided_thread_level);
+  exit_on_fail(rc_init);
+  if (provided_thread_level < MPI_THREAD_FUNNELED) {
+    std::cerr << "The MPI implementation does not support multiple threads" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // get the MPI context
+  mpi_context_type mpi_context = mpi_context_type();
+
+  // create and commit the MPI_Datatype for the string
+  MPI_Datatype mpi_string_type;
+  int rc_type = MPI_Type_contiguous(max_pattern_len + 1, MPI_CHAR, &mpi_string_type);
+  exit_on_fail(rc_type);
+  rc_type = MPI_Type_commit(&mpi_string_type);
+  exit_on_fail(rc_type);
+
+  int status = EXIT_SUCCESS;
+  if (argc == 3 && strcmp(argv[1], "--batch") == 0) {
+    if (!run_batch(mpi_context, mpi_string_type, argv[2])) status = EXIT_FAILURE;
+  } else if ((argc == 3 || argc == 4) && strcmp(argv[1], "--progressive") == 0) {
+    const double tolerance = atof(argv[2]);
+    const std::size_t top_k = argc == 4 ? std::max(atol(argv[3]), 1L) : max_dictionary_size;
+    compute_progressive_coverage(mpi_context, mpi_string_type, std::cin, std::cout, tolerance, top_k);
+  } else if ((argc == 2 || argc == 3) && strcmp(argv[1], "--stream") == 0) {
+    const std::size_t num_threads = argc == 3 ? std::max(atol(argv[2]), 1L) : 1;
+    compute_streaming_coverage(mpi_context, mpi_string_type, std::cin, std::cout, num_threads);
+  } else if (4 <= argc && strcmp(argv[1], "--diff") == 0) {
+    // every input is given as label=path (or just path, which is also its label)
+    const auto metric = strcmp(argv[2], "ratio") == 0 ? differential_metric::ratio : differential_metric::difference;
+    std::vector<std::string> labels;
+    std::vector<std::string> paths;
+    for (int i = 3; i < argc; ++i) {
+      const std::string argument = argv[i];
+      const auto separator = argument.find('=');
+      labels.push_back(separator == std::string::npos ? argument : argument.substr(0, separator));
+      paths.push_back(separator == std::string::npos ? argument : argument.substr(separator + 1));
+    }
+    compute_differential_coverage(mpi_context, mpi_string_type, labels, paths, metric, std::cout);
+  } else {
+    compute_coverage(mpi_context, mpi_string_type, std::cin, std::cout);
+  }
 
   fprintf(stderr, "Process %d terminated\n", mpi_context.rank);
 
@@ -373,5 +1157,5 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char *argv[]) {
   int rc_finalize = MPI_Finalize();
   exit_on_fail(rc_finalize);
 
-  return EXIT_SUCCESS;
+  return status;
 }
\ No newline at end of file
@@ -0,0 +1,70 @@
+#include <algorithm>
+
+#include "chunk_pipeline.hpp"
+
+chunk_pipeline::chunk_pipeline(std::size_t num_chunks, std::size_t num_consumers)
+    : chunks(num_chunks), pending_consumers(num_chunks, 0), num_consumers(num_consumers) {}
+
+chunk &chunk_pipeline::acquire() {
+  std::unique_lock<std::mutex> lock(mutex);
+  const auto slot = published % chunks.size();
+  chunk_free.wait(lock, [this, slot] { return pending_consumers[slot] == 0; });
+  return chunks[slot];
+}
+
+const chunk &chunk_pipeline::last_published() const {
+  // only the producer publishes, so it can read this without locking
+  return published == 0 ? empty_chunk : chunks[(published - 1) % chunks.size()];
+}
+
+void chunk_pipeline::publish() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending_consumers[published % chunks.size()] = num_consumers;
+    ++published;
+  }
+  chunk_ready.notify_all();
+}
+
+void chunk_pipeline::close() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    closed = true;
+  }
+  chunk_ready.notify_all();
+}
+
+const chunk *chunk_pipeline::wait(std::size_t sequence) {
+  std::unique_lock<std::mutex> lock(mutex);
+  chunk_ready.wait(lock, [this, sequence] { return sequence < published || closed; });
+  return sequence < published ? &chunks[sequence % chunks.size()] : nullptr;
+}
+
+void chunk_pipeline::release(std::size_t sequence) {
+  bool is_free;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    is_free = --pending_consumers[sequence % chunks.size()] == 0;
+  }
+  if (is_free) chunk_free.notify_all();
+}
+
+void continue_chunk(const chunk &previous, chunk &next, std::size_t size, std::size_t carry_size) {
+  next.carry = std::min(carry_size, previous.data.size());
+  next.position = previous.position + previous.data.size() - next.carry;
+  next.data.resize(next.carry + size);
+  std::copy(std::end(previous.data) - next.carry, std::end(previous.data), std::begin(next.data));
+}
+
+bool read_chunk(std::istream &input, const chunk &previous, chunk &next, std::size_t chunk_size,
+                std::size_t carry_size) {
+  continue_chunk(previous, next, chunk_size, carry_size);
+  auto filled = next.carry;
+  while (filled < next.data.size() && input.read(&next.data[filled], next.data.size() - filled).gcount() > 0) {
+    const auto begin = std::begin(next.data) + filled;
+    const auto end = begin + input.gcount();
+    filled = std::remove(begin, end, '\n') - std::begin(next.data);
+  }
+  next.data.resize(filled);
+  return next.carry < filled;
+}
@@ -0,0 +1,60 @@
+#ifndef CHALLENGE_CHUNK_PIPELINE_HDR
+#define CHALLENGE_CHUNK_PIPELINE_HDR
+
+#include <condition_variable>
+#include <cstddef>
+#include <istream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// a piece of the input stream. The first carry characters repeat the end of the previous chunk, so that the
+// ngrams crossing the boundary between two chunks are entirely contained in the second one
+struct chunk {
+  std::string data;
+  std::size_t carry = 0;     // number of characters repeated from the previous chunk
+  std::size_t position = 0;  // position of data[0] in the stream
+  std::size_t source = 0;    // index of the input the chunk comes from
+};
+
+// bounded pool of chunks that are filled, in order, by a single producer and read by all the consumers. A
+// chunk is recycled as soon as every consumer has released it, so the memory footprint does not depend on
+// the size of the input
+class chunk_pipeline {
+ public:
+  chunk_pipeline(std::size_t num_chunks, std::size_t num_consumers);
+
+  // producer side: wait for a free chunk, fill it and publish it; close once there is no more data
+  chunk &acquire();
+  const chunk &last_published() const;
+  void publish();
+  void close();
+
+  // consumer side: wait for the chunk with the given sequence number (nullptr if the stream ended before it)
+  // and release it once it has been processed
+  const chunk *wait(std::size_t sequence);
+  void release(std::size_t sequence);
+
+ private:
+  std::vector<chunk> chunks;
+  std::vector<std::size_t> pending_consumers;
+  std::size_t num_consumers;
+  std::size_t published = 0;
+  bool closed = false;
+  chunk empty_chunk;
+
+  std::mutex mutex;
+  std::condition_variable chunk_ready;
+  std::condition_variable chunk_free;
+};
+
+// fill next with at most chunk_size new characters of input (new lines are dropped, as the lines are
+// concatenated), preceded by the last carry_size characters of previous. Return false if the input has no
+// more characters
+bool read_chunk(std::istream &input, const chunk &previous, chunk &next, std::size_t chunk_size,
+                std::size_t carry_size);
+
+// prepare next to receive size new characters after the last carry_size characters of previous
+void continue_chunk(const chunk &previous, chunk &next, std::size_t size, std::size_t carry_size);
+
+#endif  // CHALLENGE_CHUNK_PIPELINE_HDR
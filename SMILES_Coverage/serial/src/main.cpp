@@ -1,10 +1,15 @@
 #include <algorithm>
+#include <array>
 #include <cstdint>
 #include <cstring>
+#include <functional>
 #include <iostream>
+#include <thread>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+#include "chunk_pipeline.hpp"
 #include "mpi_error_check.hpp"
 
 // set the maximum size of the ngram
@@ -13,6 +18,11 @@ static constexpr size_t max_dictionary_size = 128;
 static_assert(max_pattern_len > 1, "The pattern must contain at least one character");
 static_assert(max_dictionary_size > 1, "The dictionary must contain at least one element");
 
+// in streaming mode, the input is read in chunks of this size while the previous chunks are being counted
+static constexpr std::size_t stream_chunk_size = 1 << 20;  // 1MB
+static constexpr std::size_t stream_num_chunks = 8;
+static_assert(max_pattern_len < 8, "The ngram and its size must fit in a 64 bit key");
+
 // simple class to represent a word of our dictionary
 struct word {
   char ngram[max_pattern_len + 1];  // the string data, statically allocated
@@ -71,18 +81,112 @@ size_t count_coverage(const std::string &dataset, const char *ngram) {
   return counter * ngram_size;
 }
 
+// occurrences of an ngram counted so far while streaming
+struct ngram_counter {
+  size_t count = 0;
+  size_t last_start = std::string::npos;  // position of the last counted occurrence
+};
+using ngram_counters = std::unordered_map<std::uint64_t, ngram_counter>;
+
+// pack the characters of the ngram and its size in a single key
+std::uint64_t ngram_key(const char *ngram, size_t ngram_size) {
+  std::uint64_t key = std::uint64_t{ngram_size} << 56;
+  for (size_t i = 0; i < ngram_size; ++i) {
+    key |= std::uint64_t{static_cast<unsigned char>(ngram[i])} << (8 * i);
+  }
+  return key;
+}
+
+// each streaming worker counts only the ngrams it owns, so that the occurrences of an ngram are seen in order
+size_t ngram_owner(std::uint64_t key, size_t num_owners) {
+  return ((key * 0x9E3779B97F4A7C15ull) >> 32) % num_owners;
+}
+
+/**
+ * count the non-overlapping occurrences (as in count_coverage) of the ngrams owned by this worker in all the
+ * chunks of the pipeline
+ */
+void count_stream(chunk_pipeline &pipeline, size_t owner, size_t num_owners, ngram_counters &counters) {
+  for (size_t sequence = 0;; ++sequence) {
+    const chunk *current = pipeline.wait(sequence);
+    if (current == nullptr) break;
+
+    const auto &data = current->data;
+    for (size_t index = 0; index < data.size(); ++index) {
+      const auto position = current->position + index;
+      std::uint64_t key = 0;
+      for (size_t ngram_size = 1; ngram_size <= max_pattern_len && index + ngram_size <= data.size();
+           ++ngram_size) {
+        key |= std::uint64_t{static_cast<unsigned char>(data[index + ngram_size - 1])} << (8 * (ngram_size - 1));
+        if (index + ngram_size <= current->carry) continue;  // already counted with the previous chunk
+
+        const auto sized_key = key | (std::uint64_t{ngram_size} << 56);
+        if (ngram_owner(sized_key, num_owners) != owner) continue;
+        auto &counter = counters[sized_key];
+        if (counter.last_start != std::string::npos && position < counter.last_start + ngram_size) continue;
+        counter.last_start = position;
+        ++counter.count;
+      }
+    }
+    pipeline.release(sequence);
+  }
+}
+
+// coverage of a word according to the counters of the streaming workers
+size_t streamed_coverage(const std::vector<ngram_counters> &counters, const word &current_word) {
+  const auto key = ngram_key(current_word.ngram, current_word.size);
+  const auto &owner_counters = counters[ngram_owner(key, counters.size())];
+  const auto counter = owner_counters.find(key);
+  return counter == std::end(owner_counters) ? 0 : counter->second.count * current_word.size;
+}
+
 int main([[maybe_unused]] int argc, [[maybe_unused]] char *argv[]) {
-  // read the whole database of SMILES and put them in a single string
-  // NOTE: we can figure out which is our alphabet
-  std::cerr << "Reading the molecules from the standard input ..." << std::endl;
+  // with --stream [threads], the molecules are counted by the worker threads while they are being read
+  const bool stream = 2 <= argc && strcmp(argv[1], "--stream") == 0;
+  const size_t num_threads =
+      std::max(3 <= argc ? atol(argv[2]) : static_cast<long>(std::thread::hardware_concurrency()), 1L);
+
   std::unordered_set<char> alphabet_builder;
   std::string database;
-  database.reserve(209715200);  // 200MB
-  for (std::string line; std::getline(std::cin, line);
-       /* automatically handled */) {
-    for (const auto character : line) {
-      alphabet_builder.emplace(character);
-      database.push_back(character);
+  std::vector<ngram_counters> counters;
+  if (stream) {
+    std::cerr << "Streaming the molecules from the standard input to " << num_threads << " threads ..."
+              << std::endl;
+    chunk_pipeline pipeline(stream_num_chunks, num_threads);
+    counters.resize(num_threads);
+    std::vector<std::thread> workers;
+    for (size_t owner = 0; owner < num_threads; ++owner) {
+      workers.emplace_back(count_stream, std::ref(pipeline), owner, num_threads, std::ref(counters[owner]));
+    }
+
+    // NOTE: we can figure out which is our alphabet while reading, in the same order of the whole database
+    std::array<bool, 256> seen{};
+    for (;;) {
+      auto &next = pipeline.acquire();
+      if (!read_chunk(std::cin, pipeline.last_published(), next, stream_chunk_size, max_pattern_len - 1)) break;
+      for (size_t i = next.carry; i < next.data.size(); ++i) {
+        if (!seen[static_cast<unsigned char>(next.data[i])]) {
+          seen[static_cast<unsigned char>(next.data[i])] = true;
+          alphabet_builder.emplace(next.data[i]);
+        }
+      }
+      pipeline.publish();
+    }
+    pipeline.close();
+    for (auto &worker : workers) {
+      worker.join();
+    }
+  } else {
+    // read the whole database of SMILES and put them in a single string
+    // NOTE: we can figure out which is our alphabet
+    std::cerr << "Reading the molecules from the standard input ..." << std::endl;
+    database.reserve(209715200);  // 200MB
+    for (std::string line; std::getline(std::cin, line);
+         /* automatically handled */) {
+      for (const auto character : line) {
+        alphabet_builder.emplace(character);
+        database.push_back(character);
+      }
     }
   }
 
@@ -119,7 +223,8 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char *argv[]) {
       current_word.size = ngram_size;
 
       // evaluate the coverage and add the word to the dictionary
-      current_word.coverage = count_coverage(database, current_word.ngram);
+      current_word.coverage =
+          stream ? streamed_coverage(counters, current_word) : count_coverage(database, current_word.ngram);
       result.add_word(current_word);
     }
 
@@ -1,37 +1,273 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
 
 #define min(x, y) (((x) < (y)) ? (x) : (y))
 #define max(x, y) (((x) > (y)) ? (x) : (y))
 
-#define MAX_LENGTH 100
 #define UNREACHABLE -1
+#define INFINITE_COST (INT_MAX / 4) // Cost of the states that cannot be reached, small enough to add a few costs
+#define NO_BAND INT_MIN // The whole table is stored
+#define HIRSCHBERG_BLOCK 4096 // Sub-problems with fewer cells are solved with a full table
+#define WAVEFRONT_TILE 256 // Rows and columns of the tiles of the wavefront, a multiple of 4
+#define DISTRIBUTED_TILE 1024 // Rows of the left column sent at once between the ranks
+
+// 32 bit lanes for the pairs aligned together by the batch mode, a single lane without SIMD instructions
+#if defined(__AVX2__)
+#define BATCH_LANES 8
+typedef __m256i lanes_t;
+#define lanes_set1(a) _mm256_set1_epi32(a)
+#define lanes_load(p) _mm256_loadu_si256((__m256i *)(p))
+#define lanes_store(p, v) _mm256_storeu_si256((__m256i *)(p), v)
+#define lanes_add(a, b) _mm256_add_epi32(a, b)
+#define lanes_sub(a, b) _mm256_sub_epi32(a, b)
+#define lanes_min(a, b) _mm256_min_epi32(a, b)
+#define lanes_eq(a, b) _mm256_cmpeq_epi32(a, b)
+#define lanes_and(a, b) _mm256_and_si256(a, b)
+#define lanes_andnot(a, b) _mm256_andnot_si256(a, b)
+#define lanes_or(a, b) _mm256_or_si256(a, b)
+#elif defined(__SSE4_1__)
+#define BATCH_LANES 4
+typedef __m128i lanes_t;
+#define lanes_set1(a) _mm_set1_epi32(a)
+#define lanes_load(p) _mm_loadu_si128((__m128i *)(p))
+#define lanes_store(p, v) _mm_storeu_si128((__m128i *)(p), v)
+#define lanes_add(a, b) _mm_add_epi32(a, b)
+#define lanes_sub(a, b) _mm_sub_epi32(a, b)
+#define lanes_min(a, b) _mm_min_epi32(a, b)
+#define lanes_eq(a, b) _mm_cmpeq_epi32(a, b)
+#define lanes_and(a, b) _mm_and_si128(a, b)
+#define lanes_andnot(a, b) _mm_andnot_si128(a, b)
+#define lanes_or(a, b) _mm_or_si128(a, b)
+#else
+#define BATCH_LANES 1
+typedef int lanes_t;
+#define lanes_set1(a) (a)
+#define lanes_load(p) (*(p))
+#define lanes_store(p, v) (*(p) = (v))
+#define lanes_add(a, b) ((a) + (b))
+#define lanes_sub(a, b) ((a) - (b))
+#define lanes_min(a, b) min(a, b)
+#define lanes_eq(a, b) (-((a) == (b)))
+#define lanes_and(a, b) ((a) & (b))
+#define lanes_andnot(a, b) (~(a) & (b))
+#define lanes_or(a, b) ((a) | (b))
+#endif
+#define lanes_select(mask, a, b) lanes_or(lanes_and(mask, a), lanes_andnot(mask, b))
 
 #define MATCH_COST 0
 #define GAP_COST 2
 #define MISMATCH_COST 10 // Because it is 5 for both sequences, so the total cost is 10
 
+// Traceback directions, stored with 2 bits per cell
+#define TRACE_DIAG 0 // Match or mismatch
+#define TRACE_UP 1 // Gap in x
+#define TRACE_LEFT 2 // Gap in y
+
+#define BLOSUM62_ALPHABET "ARNDCQEGHILKMFPSTWYVBZX*"
+
+// Reusable memory for the dp: a few rows of costs and the traceback directions of the whole table, whose rows
+// are padded to a multiple of 4 cells so that each byte belongs to a single row
+struct dp_arena {
+    int *rows;
+    size_t rows_capacity;
+    unsigned char *trace;
+    size_t trace_capacity;
+};
+
+static _Thread_local struct dp_arena arena;
+
+// State shared by the threads of the wavefront: the last computed row and column of each tile, and the top left
+// corner of the next tile of each row of tiles
+struct wavefront {
+    char *x_reversed;
+    char *y;
+    int n, m, stride;
+    int gap_cost, mismatch_cost;
+    int tile_rows, tile_cols, num_threads;
+    int *row;
+    int *column;
+    int *corner;
+    unsigned char *trace;
+    pthread_barrier_t barrier;
+};
+
+struct wavefront_worker {
+    struct wavefront *wf;
+    int id;
+    pthread_t thread;
+};
+
+// A deque of groups of pairs, the owner thread works at the back and the other ones steal from the front
+struct task_deque {
+    int *tasks;
+    int head, tail;
+    pthread_mutex_t lock;
+};
+
+// Gap and substitution costs of the affine alignment, code maps each letter to its index in the matrix or to -1
+struct scoring {
+    int gap_open, gap_extend;
+    int alphabet_size;
+    int code[256];
+    int *matrix;
+    int uniform; // Matches cost 0 and all the mismatches cost mismatch_cost
+    int mismatch_cost;
+};
+
+struct batch_key {
+    int m, n, index;
+};
+
+struct batch_result {
+    int cost, gaps, mismatches;
+    char *x_align;
+    char *y_align;
+};
+
+// Pairs of the batch mode, sorted by lengths in order and cut in groups starting at group_start
+struct batch {
+    char **x;
+    char **y;
+    int num_pairs;
+    int *order;
+    int *group_start;
+    int num_groups;
+    struct task_deque *deques;
+    int num_threads;
+    int gap_cost, mismatch_cost;
+    int with_alignment;
+    struct batch_result *results;
+};
+
+struct batch_worker {
+    struct batch *batch;
+    int id;
+    pthread_t thread;
+};
+
+// Shared state of the search of the maximum cost strings: the canonical prefixes of y, each followed by the number
+// of letters it uses, and the best pair found so far
+struct search {
+    int n, m;
+    int gap_cost, mismatch_cost;
+    char *alphabet;
+    int alphabet_size;
+    char *prefixes;
+    int prefix_length, num_prefixes;
+    atomic_int next_prefix;
+    atomic_int best_cost;
+    int ceiling;
+    char *best_x;
+    char *best_y;
+    long nodes;
+    pthread_mutex_t lock;
+};
+
 /* Prototypes */
-void print_table(int **table, int n, int m, char *x, char *y);
+void print_table_header(int m, char *x);
+void print_table_row(int *row, int i, int m, char *y);
+void print_band_row(int *row, int i, int first_diagonal, int width, int m, char *y);
 int **allocate_table(int n, int m);
 void free_table(int **table, int n);
+void reserve_arena(struct dp_arena *arena, size_t row_cells, size_t trace_cells);
+void free_arena(struct dp_arena *arena);
+int trace_stride(int m);
+void set_trace(unsigned char *trace, size_t cell, int direction);
+int get_trace(unsigned char *trace, size_t cell);
 int find_alignment_simple(char *x, char *y, char *x_align, char *y_align, int gap_cost, int mismatch_cost);
+int fill_simple(char *x, char *y, int gap_cost, int mismatch_cost, int print_rows);
+int find_alignment_simple_banded(char *x, char *y, char *x_align, char *y_align, int gap_cost, int mismatch_cost, int band);
+int find_alignment_bounded(char *x, char *y, char *x_align, char *y_align, int gap_cost, int mismatch_cost, int threshold);
+int fill_band(char *x, char *y, int first, int last, int gap_cost, int mismatch_cost, int threshold, int print_rows);
 int find_alignment_minimum_length(char *x, char *y, char *x_align, char *y_align, int gap_cost, int mismatch_cost);
+int alignment_cost(char *x, char *y, int gap_cost, int mismatch_cost);
 int match_or_mismatch(int i, int j, char *x, char *y, int mismatch_cost);
-int solve(int **table, int n, int m, char *x, char *y, char *x_align, char *y_align, int gap_cost, int mismatch_cost);
+int trace_back(unsigned char *trace, int stride, int first_diagonal, int n, int m, char *x, char *y, char *x_align, char *y_align, int *num_gaps, int *num_mismatches);
 void generate_maximum_cost_strings(int n, int m, char *x, char *y, int gap_cost, int mismatch_cost);
+void fill_maximum_cost_pattern(int n, int m, char *x, char *y);
+int find_alignment_hirschberg(char *x, char *y, char *x_align, char *y_align, int gap_cost, int mismatch_cost);
+void hirschberg(char *x, char *y, int r0, int c0, int r1, int c1, int *cost_row, int *cross_row, char *x_align, char *y_align, int *k, int gap_cost, int mismatch_cost);
+void align_block(char *x, char *y, int r0, int c0, int r1, int c1, char *x_align, char *y_align, int *k, int gap_cost, int mismatch_cost);
+int find_alignment_wavefront(char *x, char *y, char *x_align, char *y_align, int gap_cost, int mismatch_cost, int num_threads);
+void *run_wavefront_worker(void *arg);
+void wavefront_tile(struct wavefront *wf, int ti, int tj, int *diagonals, unsigned char *tile_trace);
+void wavefront_cells(int *prev2, int *prev, int *curr, int *directions, char *y, char *x, int a_first, int a_last, int gap_cost, int mismatch_cost);
+int find_alignments_batch(FILE *input, int num_threads, int with_alignment, int gap_cost, int mismatch_cost);
+int compare_batch_keys(const void *a, const void *b);
+void *run_batch_worker(void *arg);
+void align_group(struct batch *batch, int *pairs, int size);
+int search_maximum_cost_strings(int n, int m, char *alphabet, int num_threads, int gap_cost, int mismatch_cost);
+void *run_search_worker(void *arg);
+long count_canonical_prefixes(int length, int alphabet_size);
+void list_canonical_prefixes(struct search *search, char *prefix, int length, int used, int *num_prefixes);
+void search_y(struct search *search, char *y, int length, int used, int *rows, char *x, long *nodes);
+void search_x(struct search *search, char *x, char *y, int k, int *rows, long *nodes);
+int load_scoring(struct scoring *scoring, char *name, int gap_open, int gap_extend);
+int find_alignment_affine(char *x, char *y, char *x_align, char *y_align, struct scoring *scoring);
+int fill_linear_matrix(struct scoring *scoring, char *x, char *y, int *end_state);
+int fill_affine_uniform(struct scoring *scoring, char *x, char *y, int *end_state);
+int fill_affine_matrix(struct scoring *scoring, char *x, char *y, int *end_state);
+int trace_back_scored(unsigned char *trace, int n, int m, char *x, char *y, char *x_align, char *y_align, int affine, int state, int *num_gaps, int *num_mismatches);
+#ifdef USE_MPI
+int find_alignment_distributed(char *x, char *y, char *x_align, char *y_align, int gap_cost, int mismatch_cost);
+void fill_block_row(char *x, char *y, int i, int c0, int w, int left, int *row, unsigned char *trace, int gap_cost, int mismatch_cost);
+void exit_on_fail(int return_code);
+#endif
 
 int main(int argc, char* argv[]) {
+    int status = EXIT_SUCCESS;
     if(argc == 1) {
-        printf("Usage: \n\t%s -simple <x> <y>\n\t%s -min <x> <y>\n\t%s -max <n> <m> <gap_cost> <mismatch_cost>\n", argv[0], argv[0], argv[0]);
+        printf("Usage: \n\t%s -simple <x> <y> [band]\n\t%s -min <x> <y>\n\t%s -max <n> <m> <gap_cost> <mismatch_cost>\n", argv[0], argv[0], argv[0]);
+        printf("\t%s -hirschberg <x> <y>\n\t%s -score <x> <y>\n", argv[0], argv[0]);
+        printf("\t%s -wavefront <x> <y> [threads]\n", argv[0]);
+        printf("\t%s -batch [file] [threads] [-align]\n", argv[0]);
+        printf("\t%s -bounded <x> <y> <threshold>\n", argv[0]);
+        printf("\t%s -affine <x> <y> <gap_open> <gap_extend> [dna|protein|file]\n", argv[0]);
+        printf("\t%s -search <n> <m> <gap_cost> <mismatch_cost> [alphabet] [threads]\n", argv[0]);
+        printf("\tmpirun -n <ranks> %s -distributed <x> <y>\n", argv[0]);
     }
     else {
-        char x_align[MAX_LENGTH];
-        char y_align[MAX_LENGTH];
+        // An alignment is at most as long as the two sequences together
+        int length = argc > 3 ? strlen(argv[2]) + strlen(argv[3]) + 1 : 1;
+        char *x_align = malloc(sizeof(char) * length);
+        char *y_align = malloc(sizeof(char) * length);
         switch(argv[1][3]) {
+            case 'a': // seArch of the maximum cost strings, i.e. the exhaustive version of -max
+                search_maximum_cost_strings(atoi(argv[2]), atoi(argv[3]), argc > 6 ? argv[6] : "ACGT",
+                    argc > 7 ? atoi(argv[7]) : sysconf(_SC_NPROCESSORS_ONLN), atoi(argv[4]), atoi(argv[5]));
+                break;
+            case 'f': // afFine alignment, i.e. gaps with an opening cost and a substitution matrix
+                struct scoring scoring;
+                if(load_scoring(&scoring, argc > 6 ? argv[6] : "dna", atoi(argv[4]), atoi(argv[5])) != 0) {
+                    break;
+                }
+                if(find_alignment_affine(argv[2], argv[3], x_align, y_align, &scoring) != UNREACHABLE) {
+                    printf("The minimum cost alignment is:\n");
+                    printf("%s\n", x_align);
+                    printf("%s\n", y_align);
+                }
+                free(scoring.matrix);
+                break;
             case 'm': // siMple alignment, i.e. no constraint on the number of gaps
-                find_alignment_simple(argv[2], argv[3], x_align, y_align, GAP_COST, MISMATCH_COST);
+                if(argc > 4 && atoi(argv[4]) < 0) {
+                    printf("The band must be at least 0\n");
+                    break;
+                } else if(argc > 4) {
+                    find_alignment_simple_banded(argv[2], argv[3], x_align, y_align, GAP_COST, MISMATCH_COST, atoi(argv[4]));
+                } else {
+                    find_alignment_simple(argv[2], argv[3], x_align, y_align, GAP_COST, MISMATCH_COST);
+                }
 
                 printf("The minimum cost alignment is:\n");
                 printf("%s\n", x_align);
@@ -44,12 +280,84 @@ int main(int argc, char* argv[]) {
                 printf("%s\n", x_align);
                 printf("%s\n", y_align);
                 break;
+            case 'o': // scOre only, i.e. the cost of the simple alignment without the alignment itself
+                printf("Cost: %d\n", alignment_cost(argv[2], argv[3], GAP_COST, MISMATCH_COST));
+                break;
+            case 'r': // hiRschberg alignment, i.e. the simple alignment in linear space
+                find_alignment_hirschberg(argv[2], argv[3], x_align, y_align, GAP_COST, MISMATCH_COST);
+
+                printf("The minimum cost alignment is:\n");
+                printf("%s\n", x_align);
+                printf("%s\n", y_align);
+                break;
+            case 'u': // boUnded alignment, i.e. the simple alignment only if its cost is at most a threshold
+                int threshold = atoi(argv[4]);
+                if(find_alignment_bounded(argv[2], argv[3], x_align, y_align, GAP_COST, MISMATCH_COST, threshold) == UNREACHABLE) {
+                    printf("Cost > %d\n", threshold);
+                    break;
+                }
+
+                printf("The minimum cost alignment is:\n");
+                printf("%s\n", x_align);
+                printf("%s\n", y_align);
+                break;
+            case 'v': // waVefront alignment, i.e. the simple alignment computed by anti-diagonals of tiles in parallel
+                int num_threads = argc > 4 ? atoi(argv[4]) : sysconf(_SC_NPROCESSORS_ONLN);
+                find_alignment_wavefront(argv[2], argv[3], x_align, y_align, GAP_COST, MISMATCH_COST, num_threads);
+
+                printf("The minimum cost alignment is:\n");
+                printf("%s\n", x_align);
+                printf("%s\n", y_align);
+                break;
+            case 's': // diStributed alignment, i.e. the simple alignment computed by blocks of columns on the MPI ranks
+#ifdef USE_MPI
+                int rank;
+                MPI_Init(&argc, &argv);
+                exit_on_fail(MPI_Comm_rank(MPI_COMM_WORLD, &rank));
+                find_alignment_distributed(argv[2], argv[3], x_align, y_align, GAP_COST, MISMATCH_COST);
+                if(rank == 0) {
+                    printf("The minimum cost alignment is:\n");
+                    printf("%s\n", x_align);
+                    printf("%s\n", y_align);
+                }
+                MPI_Finalize();
+#else
+                printf("The distributed mode needs MPI, compile with mpicc -DUSE_MPI\n");
+#endif
+                break;
+            case 't': // baTch alignment, i.e. the simple alignment of many pairs read from a file or stdin
+                char *path = NULL;
+                int batch_threads = sysconf(_SC_NPROCESSORS_ONLN);
+                int with_alignment = 0;
+                for(int a = 2, position = 0; a < argc; a++) {
+                    if(strcmp(argv[a], "-align") == 0) {
+                        with_alignment = 1;
+                    } else if(position++ == 0) {
+                        path = argv[a];
+                    } else {
+                        batch_threads = atoi(argv[a]);
+                    }
+                }
+
+                FILE *input = path == NULL || strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+                if(input == NULL) {
+                    printf("Cannot open %s\n", path);
+                    status = EXIT_FAILURE;
+                    break;
+                }
+                if(find_alignments_batch(input, batch_threads, with_alignment, GAP_COST, MISMATCH_COST) == -1) {
+                    status = EXIT_FAILURE;
+                }
+                if(input != stdin) {
+                    fclose(input);
+                }
+                break;
             case 'x': // maXimum cost strings, i.e. the strings with maximum cost alignment
                 int n = atoi(argv[2]);
                 int m = atoi(argv[3]);
 
-                char *x = malloc(sizeof(char) * m);
-                char *y = malloc(sizeof(char) * n);
+                char *x = calloc(max(max(n, m), 4) + 1, sizeof(char));
+                char *y = calloc(max(max(n, m), 4) + 1, sizeof(char));
 
                 int gap_cost = atoi(argv[4]);
                 int mismatch_cost = atoi(argv[5]);
@@ -68,137 +376,387 @@ int main(int argc, char* argv[]) {
                 printf("Invalid option\n");
                 break;
         }
+        free(x_align);
+        free(y_align);
+        free_arena(&arena);
     }
+    return status;
 }
 
 int find_alignment_simple(char *x, char *y, char *x_align, char *y_align, int gap_cost, int mismatch_cost) {
     int m = strlen(x);
     int n = strlen(y);
-    int **table = allocate_table(n+1, m+1);
 
-    table[0][0] = 0;
+    printf("The dp table for the simple alignment is:\n");
+    print_table_header(m, x);
 
-    for(int i = 1; i <= n; i++) {
-        table[i][0] = table[i-1][0] + gap_cost;
-    }
+    int cost = fill_simple(x, y, gap_cost, mismatch_cost, 1);
+    int num_gaps, num_mismatches;
+    trace_back(arena.trace, trace_stride(m), NO_BAND, n, m, x, y, x_align, y_align, &num_gaps, &num_mismatches);
+
+    printf("Mismatches: %d, Gaps: %d, Cost: %d\n", num_mismatches, num_gaps, cost);
+
+    return cost;
+}
+
+// Cost of the simple alignment, with the traceback directions left in the arena
+int fill_simple(char *x, char *y, int gap_cost, int mismatch_cost, int print_rows) {
+    int m = strlen(x);
+    int n = strlen(y);
+    int stride = trace_stride(m);
+    reserve_arena(&arena, 2 * (m+1), (size_t)(n+1) * stride);
 
+    // Only two rows of costs are kept, the path is recovered from the traceback directions
+    int *prev = arena.rows;
+    int *curr = arena.rows + m + 1;
+    unsigned char *trace = arena.trace;
+
+    curr[0] = 0;
     for(int j = 1; j <= m; j++) {
-        table[0][j] = table[0][j-1] + gap_cost;
+        curr[j] = curr[j-1] + gap_cost;
+        set_trace(trace, j, TRACE_LEFT);
+    }
+    if(print_rows) {
+        print_table_row(curr, 0, m, y);
     }
 
     // C[i][j]=min{C[i-1][j]+GAP_COST, C[i][j-1]+GAP_COST, C[i-1][j-1]+MISMATCH_COST if x[i]!=y[j], C[i-1][j-1] if x[i]==y[j]}
     for(int i = 1; i<=n; i++) {
+        int *temp = prev;
+        prev = curr;
+        curr = temp;
+        unsigned char *trace_row = trace + (size_t)i * stride / 4;
+
+        curr[0] = prev[0] + gap_cost;
+        set_trace(trace_row, 0, TRACE_UP);
         for(int j = 1; j<=m; j++) {
-            table[i][j] = min(
-                min(
-                    table[i-1][j] + gap_cost,
-                    table[i][j-1] + gap_cost
-                    ),
-                table[i-1][j-1] + match_or_mismatch(j-1, i-1, x, y, mismatch_cost));
+            int diag = prev[j-1] + (x[j-1] == y[i-1] ? 0 : mismatch_cost);
+            int up = prev[j] + gap_cost;
+            int left = curr[j-1] + gap_cost;
+            int best = min(diag, min(up, left));
+
+            // Preference on ties: match or mismatch, then gap in x, then gap in y
+            curr[j] = best;
+            set_trace(trace_row, j, diag == best ? TRACE_DIAG : (up == best ? TRACE_UP : TRACE_LEFT));
+        }
+        if(print_rows) {
+            print_table_row(curr, i, m, y);
         }
     }
 
+    return curr[m];
+}
+
+// Same as find_alignment_simple, but only the cells whose diagonal j-i is at most band away from the diagonals
+// between (0, 0) and (n, m) are computed; the result is the simple alignment if it does not leave the band
+int find_alignment_simple_banded(char *x, char *y, char *x_align, char *y_align, int gap_cost, int mismatch_cost, int band) {
+    int m = strlen(x);
+    int n = strlen(y);
+    // A band wider than the sequences covers the whole table, and the diagonals outside it add nothing
+    band = min(band, max(n, m));
+    int first = max(min(0, m-n) - band, -n);
+    int last = min(max(0, m-n) + band, m);
+
     printf("The dp table for the simple alignment is:\n");
-    print_table(table, n, m, x, y);
+    print_table_header(m, x);
 
-    int cost = solve(table, n, m, x, y, x_align, y_align, gap_cost, mismatch_cost);
+    int cost = fill_band(x, y, first, last, gap_cost, mismatch_cost, INT_MAX, 1);
+    int num_gaps, num_mismatches;
+    trace_back(arena.trace, trace_stride(last - first), first, n, m, x, y, x_align, y_align, &num_gaps, &num_mismatches);
 
-    free_table(table, n+1);
+    printf("Mismatches: %d, Gaps: %d, Cost: %d\n", num_mismatches, num_gaps, cost);
 
     return cost;
 }
 
-int find_alignment_minimum_length(char *x, char *y, char *x_align, char *y_align, int gap_cost, int mismatch_cost) {
+// Simple alignment if its cost is at most threshold, otherwise UNREACHABLE. A cell on diagonal d = j-i needs at
+// least |d| gaps to be reached and |m-n-d| more to reach (n, m), so only the diagonals where those gaps cost at
+// most threshold are computed, and the rows stop as soon as none of their cells can lead to a cost under it
+int find_alignment_bounded(char *x, char *y, char *x_align, char *y_align, int gap_cost, int mismatch_cost, int threshold) {
     int m = strlen(x);
     int n = strlen(y);
+    int extra = gap_cost > 0 ? (threshold / gap_cost - abs(m-n)) / 2 : max(n, m);
+    if(threshold < 0 || extra < 0) {
+        return UNREACHABLE;
+    }
+    // The diagonals outside the table add nothing, even when the threshold is much larger than the sequences
+    int first = max(min(0, m-n) - extra, -n);
+    int last = min(max(0, m-n) + extra, m);
 
-    int max_gaps = max(n, m) - min(n, m);
+    int cost = fill_band(x, y, first, last, gap_cost, mismatch_cost, threshold, 0);
+    if(cost == UNREACHABLE || cost > threshold) {
+        return UNREACHABLE;
+    }
+    int num_gaps, num_mismatches;
+    trace_back(arena.trace, trace_stride(last - first), first, n, m, x, y, x_align, y_align, &num_gaps, &num_mismatches);
 
-    int **table = allocate_table(n+1, m+1);
-    int **cum_gaps = allocate_table(n+1, m+1);
+    printf("Mismatches: %d, Gaps: %d, Cost: %d\n", num_mismatches, num_gaps, cost);
 
-    table[0][0] = 0;
-    cum_gaps[0][0] = 0;
+    return cost;
+}
 
-    for(int i=1; i<=max_gaps && i<=n; i++) {
-        table[i][0] = table[i-1][0] + gap_cost;
-        cum_gaps[i][0] = cum_gaps[i-1][0] + 1;
-    }
+// Simple alignment restricted to the diagonals first..last, with the traceback directions left in the arena. Each
+// row stores those diagonals, so cell (i, j) is at index j-i-first of row i. Returns UNREACHABLE as soon as every
+// cell of a row, plus the gaps still needed to reach (n, m), costs more than threshold
+int fill_band(char *x, char *y, int first, int last, int gap_cost, int mismatch_cost, int threshold, int print_rows) {
+    int m = strlen(x);
+    int n = strlen(y);
+    int width = last - first + 1;
+    int stride = trace_stride(width - 1);
+    reserve_arena(&arena, 2 * width, (size_t)(n+1) * stride);
 
-    for(int i=max_gaps+1; i<=n; i++) {
-        table[i][0] = UNREACHABLE;
+    int *prev = arena.rows;
+    int *curr = arena.rows + width;
+    unsigned char *trace = arena.trace;
+
+    for(int t = 0; t < width; t++) {
+        int j = t + first;
+        curr[t] = UNREACHABLE;
+        if(j >= 0 && j <= m) {
+            curr[t] = j * gap_cost;
+            set_trace(trace, t, TRACE_LEFT);
+        }
     }
+    if(print_rows) {
+        print_band_row(curr, 0, first, width, m, y);
+    }
+
+    for(int i = 1; i<=n; i++) {
+        int *temp = prev;
+        prev = curr;
+        curr = temp;
+        unsigned char *trace_row = trace + (size_t)i * stride / 4;
+        int row_bound = INT_MAX;
 
-    for(int j=1; j<=max_gaps && j<=m; j++) {
-        table[0][j] = table[0][j-1] + gap_cost;
-        cum_gaps[0][j] = cum_gaps[0][j-1] + 1;
+        for(int t = 0; t < width; t++) {
+            int j = i + first + t;
+            curr[t] = UNREACHABLE;
+            if(j < 0 || j > m) {
+                continue;
+            }
+            if(j == 0) {
+                curr[t] = prev[t+1] + gap_cost;
+                set_trace(trace_row, t, TRACE_UP);
+            } else {
+                // (i-1, j-1) is on the same diagonal, (i-1, j) on the next one and (i, j-1) on the previous one
+                int best = prev[t] + (x[j-1] == y[i-1] ? 0 : mismatch_cost);
+                int direction = TRACE_DIAG;
+                if(t+1 < width && prev[t+1] + gap_cost < best) {
+                    best = prev[t+1] + gap_cost;
+                    direction = TRACE_UP;
+                }
+                if(t > 0 && curr[t-1] + gap_cost < best) {
+                    best = curr[t-1] + gap_cost;
+                    direction = TRACE_LEFT;
+                }
+                curr[t] = best;
+                set_trace(trace_row, t, direction);
+            }
+            row_bound = min(row_bound, curr[t] + abs(m - j - (n - i)) * gap_cost);
+        }
+        if(print_rows) {
+            print_band_row(curr, i, first, width, m, y);
+        }
+        if(row_bound > threshold) {
+            return UNREACHABLE;
+        }
     }
 
-    for(int j=max_gaps+1; j<=m; j++) {
-        table[0][j] = UNREACHABLE;
-        // cum_gaps here is not important
+    return curr[m - n - first];
+}
+
+// A minimum length alignment has exactly |n-m| gaps, so all of them move away from the diagonal j-i = 0 towards the
+// diagonal m-n, and only the cells between those two diagonals are computed
+int find_alignment_minimum_length(char *x, char *y, char *x_align, char *y_align, int gap_cost, int mismatch_cost) {
+    int m = strlen(x);
+    int n = strlen(y);
+
+    int max_gaps = max(n, m) - min(n, m);
+
+    // Each row stores the diagonals first..last, so cell (i, j) is at index j-i-first of row i
+    int first = min(0, m-n);
+    int last = max(0, m-n);
+    int width = last - first + 1;
+    int stride = trace_stride(width - 1);
+    reserve_arena(&arena, 4 * width, (size_t)(n+1) * stride);
+
+    // Two rows of costs and two of cumulative gaps, the path is recovered from the traceback directions
+    int *table_prev = arena.rows;
+    int *table_curr = arena.rows + width;
+    int *gaps_prev = arena.rows + 2 * width;
+    int *gaps_curr = arena.rows + 3 * width;
+    unsigned char *trace = arena.trace;
+
+    printf("The dp table for the minimum length alignment is:\n");
+    print_table_header(m, x);
+
+    for(int t = 0; t < width; t++) {
+        int j = t + first;
+        table_curr[t] = UNREACHABLE;
+        if(j >= 0 && j <= m) {
+            table_curr[t] = j * gap_cost;
+            gaps_curr[t] = j;
+            set_trace(trace, t, TRACE_LEFT);
+        }
     }
+    print_band_row(table_curr, 0, first, width, m, y);
 
     for(int i=1; i<=n; i++) {
-        for(int j=1; j<=m; j++) {
-            table[i][j] = UNREACHABLE;
-            if(table[i-1][j-1] != UNREACHABLE) {
-                int min_cum_gaps = cum_gaps[i-1][j-1];
-                table[i][j] = table[i-1][j-1] + match_or_mismatch(j-1, i-1, x, y, mismatch_cost);
-
-                if(table[i-1][j] != UNREACHABLE) {
-                        if(cum_gaps[i-1][j] + 1 < min_cum_gaps && cum_gaps[i-1][j] + 1 <= max_gaps) {
-                            min_cum_gaps = cum_gaps[i-1][j] + 1;
-                            table[i][j] = table[i-1][j] + gap_cost;
-                        } else if(cum_gaps[i-1][j] + 1 == min_cum_gaps && cum_gaps[i-1][j] + 1 <= max_gaps) {
-                            if(table[i-1][j] + gap_cost < table[i][j]) {
-                                table[i][j] = table[i-1][j] + gap_cost;
-                            }
+        int *temp = table_prev;
+        table_prev = table_curr;
+        table_curr = temp;
+        temp = gaps_prev;
+        gaps_prev = gaps_curr;
+        gaps_curr = temp;
+        unsigned char *trace_row = trace + (size_t)i * stride / 4;
+
+        for(int t = 0; t < width; t++) {
+            int j = i + first + t;
+            table_curr[t] = UNREACHABLE;
+            if(j < 0 || j > m) {
+                continue;
+            }
+            if(j == 0) {
+                table_curr[t] = table_prev[t+1] + gap_cost;
+                gaps_curr[t] = gaps_prev[t+1] + 1;
+                set_trace(trace_row, t, TRACE_UP);
+                continue;
+            }
+
+            // (i-1, j-1) is on the same diagonal, (i-1, j) on the next one and (i, j-1) on the previous one
+            int up = t+1 < width ? table_prev[t+1] : UNREACHABLE;
+            int left = t > 0 ? table_curr[t-1] : UNREACHABLE;
+            if(table_prev[t] != UNREACHABLE) {
+                int min_cum_gaps = gaps_prev[t];
+                int direction = TRACE_DIAG;
+                table_curr[t] = table_prev[t] + match_or_mismatch(j-1, i-1, x, y, mismatch_cost);
+
+                if(up != UNREACHABLE) {
+                    if(gaps_prev[t+1] + 1 < min_cum_gaps && gaps_prev[t+1] + 1 <= max_gaps) {
+                        min_cum_gaps = gaps_prev[t+1] + 1;
+                        table_curr[t] = up + gap_cost;
+                        direction = TRACE_UP;
+                    } else if(gaps_prev[t+1] + 1 == min_cum_gaps && gaps_prev[t+1] + 1 <= max_gaps) {
+                        if(up + gap_cost < table_curr[t]) {
+                            table_curr[t] = up + gap_cost;
+                            direction = TRACE_UP;
                         }
                     }
-                if(table[i][j-1] != UNREACHABLE) {
-                    if(cum_gaps[i][j-1] + 1 < min_cum_gaps && cum_gaps[i][j-1] + 1 <= max_gaps) {
-                        min_cum_gaps = cum_gaps[i][j-1] + 1;
-                        table[i][j] = table[i][j-1] + gap_cost;
-                    } else if(cum_gaps[i][j-1] + 1 == min_cum_gaps && cum_gaps[i][j-1] + 1 <= max_gaps) {
-                        if(table[i][j-1] + gap_cost < table[i][j]) {
-                            table[i][j] = table[i][j-1] + gap_cost;
+                }
+                if(left != UNREACHABLE) {
+                    if(gaps_curr[t-1] + 1 < min_cum_gaps && gaps_curr[t-1] + 1 <= max_gaps) {
+                        min_cum_gaps = gaps_curr[t-1] + 1;
+                        table_curr[t] = left + gap_cost;
+                        direction = TRACE_LEFT;
+                    } else if(gaps_curr[t-1] + 1 == min_cum_gaps && gaps_curr[t-1] + 1 <= max_gaps) {
+                        if(left + gap_cost < table_curr[t]) {
+                            table_curr[t] = left + gap_cost;
+                            direction = TRACE_LEFT;
                         }
                     }
                 }
-                cum_gaps[i][j] = min_cum_gaps;
+                gaps_curr[t] = min_cum_gaps;
+                set_trace(trace_row, t, direction);
             }
         }
+        print_band_row(table_curr, i, first, width, m, y);
     }
 
-    // printf("The cum_gaps table is:\n"); // DEBUGGING PRINT
-    // print_table(cum_gaps, n, m, x, y);
+    int cost = table_curr[m - n - first];
+    int num_gaps, num_mismatches;
+    trace_back(trace, stride, first, n, m, x, y, x_align, y_align, &num_gaps, &num_mismatches);
 
-    printf("The dp table for the minimum length alignment is:\n");
-    print_table(table, n, m, x, y);
+    printf("Mismatches: %d, Gaps: %d, Cost: %d\n", num_mismatches, num_gaps, cost);
 
-    int cost = solve(table, n, m, x, y, x_align, y_align, gap_cost, mismatch_cost);
+    return cost;
+}
 
-    free_table(table, n+1);
+// Cost of the simple alignment, keeping a single row of the table
+int alignment_cost(char *x, char *y, int gap_cost, int mismatch_cost) {
+    int m = strlen(x);
+    int n = strlen(y);
+    reserve_arena(&arena, m+1, 0);
+    int *row = arena.rows;
 
-    return cost;
+    for(int j = 0; j <= m; j++) {
+        row[j] = j * gap_cost;
+    }
+    for(int i = 1; i <= n; i++) {
+        int diag = row[0];
+        row[0] += gap_cost;
+        for(int j = 1; j <= m; j++) {
+            int cost = min(
+                min(
+                    row[j] + gap_cost,
+                    row[j-1] + gap_cost
+                    ),
+                diag + (x[j-1] == y[i-1] ? 0 : mismatch_cost));
+            diag = row[j];
+            row[j] = cost;
+        }
+    }
+    return row[m];
 }
 
+// The rows are stored contiguously, right after the row pointers, so the whole table is a single allocation
 int **allocate_table(int n, int m) {
-    int **table = malloc(sizeof(int *) * n);
+    int **table = malloc(sizeof(int *) * n + sizeof(int) * (size_t)n * m);
+    if(table == NULL) {
+        return NULL;
+    }
+    int *cells = (int *)(table + n);
     for(int i = 0; i<n; i++) {
-        table[i] = malloc(sizeof(int) * m);
+        table[i] = cells + (size_t)i * m;
     }
     return table;
 }
 
 void free_table(int **table, int n) {
-    for(int i = 0; i<n; i++) {
-        free(table[i]);
-        table[i] = NULL;
-    }
+    (void)n;
     free(table);
-    table = NULL;
+}
+
+void reserve_arena(struct dp_arena *arena, size_t row_cells, size_t trace_cells) {
+    if(arena->rows_capacity < row_cells) {
+        free(arena->rows);
+        arena->rows = malloc(sizeof(int) * row_cells);
+        arena->rows_capacity = row_cells;
+        if(arena->rows == NULL) {
+            printf("Cannot allocate %zu cells of dp rows\n", row_cells);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if(arena->trace_capacity < trace_cells) {
+        free(arena->trace);
+        arena->trace = malloc(trace_cells / 4);
+        arena->trace_capacity = trace_cells;
+        if(arena->trace == NULL) {
+            printf("Cannot allocate %zu cells of traceback\n", trace_cells);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+void free_arena(struct dp_arena *arena) {
+    free(arena->rows);
+    free(arena->trace);
+    arena->rows = NULL;
+    arena->trace = NULL;
+    arena->rows_capacity = 0;
+    arena->trace_capacity = 0;
+}
+
+int trace_stride(int m) {
+    return (m + 1 + 3) & ~3;
+}
+
+void set_trace(unsigned char *trace, size_t cell, int direction) {
+    int shift = 2 * (cell & 3);
+    trace[cell >> 2] = (trace[cell >> 2] & ~(3 << shift)) | (direction << shift);
+}
+
+int get_trace(unsigned char *trace, size_t cell) {
+    return (trace[cell >> 2] >> (2 * (cell & 3))) & 3;
 }
 
 int match_or_mismatch(int i, int j, char *x, char *y, int mismatch_cost) {
@@ -209,15 +767,19 @@ int match_or_mismatch(int i, int j, char *x, char *y, int mismatch_cost) {
     }
 }
 
-int solve(int **table, int n, int m, char *x, char *y, char *x_align, char *y_align, int gap_cost, int mismatch_cost) {
+// Follow the traceback directions from (n, m) back to (0, 0), writing the alignment. Cell (i, j) is at column j of
+// row i, or at column j-i-first_diagonal for a banded table whose rows start from the diagonal first_diagonal
+int trace_back(unsigned char *trace, int stride, int first_diagonal, int n, int m, char *x, char *y, char *x_align, char *y_align, int *num_gaps, int *num_mismatches) {
     int i = n;
     int j = m;
     int k = 0;
-    int num_mismatches = 0;
-    int num_gaps = 0;
+    *num_mismatches = 0;
+    *num_gaps = 0;
 
     while (i > 0 || j > 0) {
-        if (i > 0 && j > 0 && table[i][j] == table[i-1][j-1] + match_or_mismatch(j-1, i-1, x, y, mismatch_cost)) {
+        int column = first_diagonal == NO_BAND ? j : j - i - first_diagonal;
+        int direction = get_trace(trace, (size_t)i * stride + column);
+        if (direction == TRACE_DIAG) {
             if(x[j-1] == y[i-1]) {
                 // Match
                 x_align[k] = x[j-1];
@@ -226,21 +788,21 @@ int solve(int **table, int n, int m, char *x, char *y, char *x_align, char *y_al
                 // Mismatch
                 x_align[k] = '*';
                 y_align[k] = '*';
-                num_mismatches++;
+                (*num_mismatches)++;
             }
             i--;
             j--;
-        } else if (i > 0 && table[i][j] == table[i-1][j] + gap_cost) {
+        } else if (direction == TRACE_UP) {
             // Gap in x
             x_align[k] = '-';
             y_align[k] = y[i-1];
-            num_gaps++;
+            (*num_gaps)++;
             i--;
         } else {
             // Gap in y
             x_align[k] = x[j-1];
             y_align[k] = '-';
-            num_gaps++;
+            (*num_gaps)++;
             j--;
         }
         k++;
@@ -259,12 +821,29 @@ int solve(int **table, int n, int m, char *x, char *y, char *x_align, char *y_al
     x_align[k] = '\0';
     y_align[k] = '\0';
 
-    printf("Mismatches: %d, Gaps: %d, Cost: %d\n", num_mismatches, num_gaps, table[n][m]);
-
-    return table[n][m];
+    return k;
 }
 
 void generate_maximum_cost_strings(int n, int m, char *x, char *y, int gap_cost, int mismatch_cost) {
+    fill_maximum_cost_pattern(n, m, x, y);
+
+    char *x_align = malloc(sizeof(char) * (n + m + 1));
+    char *y_align = malloc(sizeof(char) * (n + m + 1));
+
+    int cost = find_alignment_minimum_length(x, y, x_align, y_align, gap_cost, mismatch_cost);
+
+    printf("The maximum cost is: %d\n", cost);
+
+    printf("The alignment is:\n");
+    printf("%s\n", x_align);
+    printf("%s\n", y_align);
+
+    free(x_align);
+    free(y_align);
+}
+
+// GTAC against TACG, then x is padded with C and y with G, the longer length goes to y
+void fill_maximum_cost_pattern(int n, int m, char *x, char *y) {
     if(n < m) {
         int temp = n;
         n = m;
@@ -289,38 +868,1451 @@ void generate_maximum_cost_strings(int n, int m, char *x, char *y, int gap_cost,
     for(int j = m; j<n; j++) {
         y[j] = 'G';
     }
+}
 
-    char x_align[MAX_LENGTH];
-    char y_align[MAX_LENGTH];
+int find_alignment_hirschberg(char *x, char *y, char *x_align, char *y_align, int gap_cost, int mismatch_cost) {
+    int m = strlen(x);
+    int n = strlen(y);
 
-    int cost = find_alignment_minimum_length(x, y, x_align, y_align, gap_cost, mismatch_cost);
+    // Only two rows of the dp table are kept: the costs and, for the rows below the middle one, the column where
+    // the alignment ending in each cell leaves the middle row
+    int *cost_row = malloc(sizeof(int) * (m+1));
+    int *cross_row = malloc(sizeof(int) * (m+1));
+    int k = 0;
 
-    printf("The maximum cost is: %d\n", cost);
+    hirschberg(x, y, 0, 0, n, m, cost_row, cross_row, x_align, y_align, &k, gap_cost, mismatch_cost);
+    x_align[k] = '\0';
+    y_align[k] = '\0';
 
-    printf("The alignment is:\n");
-    printf("%s\n", x_align);
-    printf("%s\n", y_align);
+    free(cost_row);
+    free(cross_row);
+
+    int num_mismatches = 0;
+    int num_gaps = 0;
+    for(int i = 0; i<k; i++) {
+        if(x_align[i] == '*') {
+            num_mismatches++;
+        } else if(x_align[i] == '-' || y_align[i] == '-') {
+            num_gaps++;
+        }
+    }
+    int cost = num_mismatches * mismatch_cost + num_gaps * gap_cost;
+
+    printf("Mismatches: %d, Gaps: %d, Cost: %d\n", num_mismatches, num_gaps, cost);
+
+    return cost;
 }
 
-void print_table(int **table, int n, int m, char *x, char *y) {
-    printf("       |");
-    for(int i = 0; i<m; i++) {
-        printf("%3c|", x[i]);
+// Append to the alignment the path from (r0, c0) to (r1, c1), both cells are on the alignment found by find_alignment_simple().
+// Inside the rectangle, the dp table relative to (r0, c0) leads the traceback to the same choices of the whole table,
+// so the rectangle is split in two where that path leaves its middle row
+void hirschberg(char *x, char *y, int r0, int c0, int r1, int c1, int *cost_row, int *cross_row, char *x_align, char *y_align, int *k, int gap_cost, int mismatch_cost) {
+    // The area overflows an int for sequences of about 46341 letters
+    if(r1 - r0 <= 1 || (size_t)(r1 - r0 + 1) * (c1 - c0 + 1) <= HIRSCHBERG_BLOCK) {
+        align_block(x, y, r0, c0, r1, c1, x_align, y_align, k, gap_cost, mismatch_cost);
+        return;
     }
-    printf("\n");
-    for(int i = 0; i<=m; i++) {
-        printf("-----");
+
+    int mid = (r0 + r1) / 2;
+    int w = c1 - c0;
+
+    for(int b = 0; b <= w; b++) {
+        cost_row[b] = b * gap_cost;
     }
-    printf("\n");
-    for(int i = 0; i<=n; i++) {
-        if (i == 0) {
-            printf("   |");
+
+    for(int i = r0+1; i <= r1; i++) {
+        int diag_cost = cost_row[0];
+        int diag_cross = cross_row[0];
+        cost_row[0] += gap_cost;
+        if(i == mid) {
+            cross_row[0] = c0;
+        }
+
+        for(int b = 1; b <= w; b++) {
+            int j = c0 + b;
+            int diag = diag_cost + match_or_mismatch(j-1, i-1, x, y, mismatch_cost);
+            int up = cost_row[b] + gap_cost;
+            int left = cost_row[b-1] + gap_cost;
+            int best = min(diag, min(up, left));
+
+            // Same preference of the simple alignment: match or mismatch, then gap in x, then gap in y
+            int cross;
+            if(diag == best) {
+                cross = i == mid ? j : diag_cross;
+            } else if(up == best) {
+                cross = i == mid ? j : cross_row[b];
+            } else {
+                cross = cross_row[b-1];
+            }
+
+            diag_cost = cost_row[b];
+            diag_cross = cross_row[b];
+            cost_row[b] = best;
+            cross_row[b] = cross;
+        }
+    }
+
+    int split = cross_row[w];
+    hirschberg(x, y, r0, c0, mid, split, cost_row, cross_row, x_align, y_align, k, gap_cost, mismatch_cost);
+    hirschberg(x, y, mid, split, r1, c1, cost_row, cross_row, x_align, y_align, k, gap_cost, mismatch_cost);
+}
+
+// Append to the alignment the path from (r0, c0) to (r1, c1) computed with a full table, as in the simple alignment
+void align_block(char *x, char *y, int r0, int c0, int r1, int c1, char *x_align, char *y_align, int *k, int gap_cost, int mismatch_cost) {
+    int h = r1 - r0;
+    int w = c1 - c0;
+    int **table = allocate_table(h+1, w+1);
+    if(table == NULL) {
+        printf("Cannot allocate the %dx%d table of a block\n", h+1, w+1);
+        exit(EXIT_FAILURE);
+    }
+
+    table[0][0] = 0;
+    for(int a = 1; a <= h; a++) {
+        table[a][0] = table[a-1][0] + gap_cost;
+    }
+    for(int b = 1; b <= w; b++) {
+        table[0][b] = table[0][b-1] + gap_cost;
+    }
+    for(int a = 1; a <= h; a++) {
+        for(int b = 1; b <= w; b++) {
+            table[a][b] = min(
+                min(
+                    table[a-1][b] + gap_cost,
+                    table[a][b-1] + gap_cost
+                    ),
+                table[a-1][b-1] + match_or_mismatch(c0+b-1, r0+a-1, x, y, mismatch_cost));
+        }
+    }
+
+    // Trace back as in the simple alignment, then reverse the appended part
+    int start = *k;
+    int a = h;
+    int b = w;
+    while (a > 0 || b > 0) {
+        int i = r0 + a;
+        int j = c0 + b;
+        if (a > 0 && b > 0 && table[a][b] == table[a-1][b-1] + match_or_mismatch(j-1, i-1, x, y, mismatch_cost)) {
+            if(x[j-1] == y[i-1]) {
+                x_align[*k] = x[j-1];
+                y_align[*k] = y[i-1];
+            } else {
+                x_align[*k] = '*';
+                y_align[*k] = '*';
+            }
+            a--;
+            b--;
+        } else if (a > 0 && table[a][b] == table[a-1][b] + gap_cost) {
+            x_align[*k] = '-';
+            y_align[*k] = y[i-1];
+            a--;
         } else {
-            printf(" %c |", y[i-1]);
+            x_align[*k] = x[j-1];
+            y_align[*k] = '-';
+            b--;
+        }
+        (*k)++;
+    }
+
+    for(int i = 0; i < (*k - start)/2; i++) {
+        char temp = x_align[start+i];
+        x_align[start+i] = x_align[*k-i-1];
+        x_align[*k-i-1] = temp;
+        temp = y_align[start+i];
+        y_align[start+i] = y_align[*k-i-1];
+        y_align[*k-i-1] = temp;
+    }
+
+    free_table(table, h+1);
+}
+
+// The table is split in tiles of WAVEFRONT_TILE rows and columns, and the tiles on the same anti-diagonal are
+// computed in parallel. The column boundaries are chosen so that each tile covers whole bytes of the traceback
+// rows: tile tj covers the columns (bounds[tj], bounds[tj+1]] with bounds[tj] = max(tj*WAVEFRONT_TILE-1, 0)
+int find_alignment_wavefront(char *x, char *y, char *x_align, char *y_align, int gap_cost, int mismatch_cost, int num_threads) {
+    struct wavefront wf;
+    wf.m = strlen(x);
+    wf.n = strlen(y);
+    wf.y = y;
+    wf.gap_cost = gap_cost;
+    wf.mismatch_cost = mismatch_cost;
+    wf.stride = trace_stride(wf.m);
+    wf.tile_rows = (wf.n + WAVEFRONT_TILE - 1) / WAVEFRONT_TILE;
+    wf.tile_cols = wf.m == 0 ? 0 : (wf.m + WAVEFRONT_TILE) / WAVEFRONT_TILE;
+    wf.num_threads = max(1, min(num_threads, min(wf.tile_rows, wf.tile_cols)));
+
+    // x is reversed, so that the characters compared along an anti-diagonal are contiguous in both strings
+    wf.x_reversed = malloc(wf.m + 1);
+    for(int j = 0; j < wf.m; j++) {
+        wf.x_reversed[j] = x[wf.m-1-j];
+    }
+
+    reserve_arena(&arena, (wf.m+1) + (wf.n+1) + wf.tile_rows, (size_t)(wf.n+1) * wf.stride);
+    wf.row = arena.rows;
+    wf.column = arena.rows + wf.m + 1;
+    wf.corner = arena.rows + wf.m + 1 + wf.n + 1;
+    wf.trace = arena.trace;
+
+    for(int j = 0; j <= wf.m; j++) {
+        wf.row[j] = j * gap_cost;
+        set_trace(wf.trace, j, TRACE_LEFT);
+    }
+    for(int i = 1; i <= wf.n; i++) {
+        set_trace(wf.trace + (size_t)i * wf.stride / 4, 0, TRACE_UP);
+    }
+
+    struct wavefront_worker *workers = malloc(sizeof(struct wavefront_worker) * wf.num_threads);
+    pthread_barrier_init(&wf.barrier, NULL, wf.num_threads);
+    for(int t = 0; t < wf.num_threads; t++) {
+        workers[t].wf = &wf;
+        workers[t].id = t;
+        if(t > 0) {
+            pthread_create(&workers[t].thread, NULL, run_wavefront_worker, &workers[t]);
         }
-        for(int j = 0; j<=m; j++) {
-            printf("%3d|", table[i][j]);
+    }
+    run_wavefront_worker(&workers[0]);
+    for(int t = 1; t < wf.num_threads; t++) {
+        pthread_join(workers[t].thread, NULL);
+    }
+    pthread_barrier_destroy(&wf.barrier);
+    free(workers);
+    free(wf.x_reversed);
+
+    // The last row left in the buffer is the last row of the table
+    int cost = wf.m == 0 ? wf.n * gap_cost : wf.row[wf.m];
+    int num_gaps, num_mismatches;
+    trace_back(wf.trace, wf.stride, NO_BAND, wf.n, wf.m, x, y, x_align, y_align, &num_gaps, &num_mismatches);
+
+    printf("Mismatches: %d, Gaps: %d, Cost: %d\n", num_mismatches, num_gaps, cost);
+
+    return cost;
+}
+
+void *run_wavefront_worker(void *arg) {
+    struct wavefront_worker *worker = arg;
+    struct wavefront *wf = worker->wf;
+
+    // Three anti-diagonals of the tile, plus the directions of the last one, and the directions of the whole tile
+    int *diagonals = malloc(sizeof(int) * 4 * (WAVEFRONT_TILE + 1));
+    unsigned char *tile_trace = malloc(WAVEFRONT_TILE * WAVEFRONT_TILE);
+
+    for(int d = 0; d < wf->tile_rows + wf->tile_cols - 1; d++) {
+        int first = max(0, d - wf->tile_cols + 1);
+        int last = min(wf->tile_rows - 1, d);
+        for(int ti = first + worker->id; ti <= last; ti += wf->num_threads) {
+            wavefront_tile(wf, ti, d - ti, diagonals, tile_trace);
+        }
+        pthread_barrier_wait(&wf->barrier);
+    }
+
+    free(diagonals);
+    free(tile_trace);
+    return NULL;
+}
+
+// The tile reads the row above it and the column at its left from the shared buffers, and overwrites them with its
+// last row and last column. The top left corner was overwritten by the tile above, so that tile saves it for the
+// next tile of its row, which runs on the following anti-diagonal
+void wavefront_tile(struct wavefront *wf, int ti, int tj, int *diagonals, unsigned char *tile_trace) {
+    int r0 = ti * WAVEFRONT_TILE;
+    int r1 = min(r0 + WAVEFRONT_TILE, wf->n);
+    int c0 = max(tj * WAVEFRONT_TILE - 1, 0);
+    int c1 = min((tj + 1) * WAVEFRONT_TILE - 1, wf->m);
+    int h = r1 - r0;
+    int w = c1 - c0;
+
+    int corner = tj == 0 ? r0 * wf->gap_cost : wf->corner[ti];
+    wf->corner[ti] = wf->row[c1];
+
+    int *prev2 = diagonals;
+    int *prev = diagonals + (WAVEFRONT_TILE + 1);
+    int *curr = diagonals + 2 * (WAVEFRONT_TILE + 1);
+    int *directions = diagonals + 3 * (WAVEFRONT_TILE + 1);
+
+    // Cell (a, b) of the tile is cell (r0+a, c0+b) of the table, and it is stored at index a of anti-diagonal a+b
+    for(int k = 0; k <= h + w; k++) {
+        if(k <= w) {
+            curr[0] = k == 0 ? corner : wf->row[c0+k];
+        }
+        if(k >= 1 && k <= h) {
+            curr[k] = tj == 0 ? (r0+k) * wf->gap_cost : wf->column[r0+k];
+        }
+
+        int a_first = max(1, k - w);
+        int a_last = min(h, k - 1);
+        if(a_first <= a_last) {
+            // y[r0+a-1] is compared with x[c0+k-a-1], i.e. x_reversed[m-c0-k+a]
+            wavefront_cells(prev2, prev, curr, directions, wf->y + r0 - 1, wf->x_reversed + wf->m - c0 - k,
+                a_first, a_last, wf->gap_cost, wf->mismatch_cost);
+            for(int a = a_first; a <= a_last; a++) {
+                tile_trace[(a-1) * WAVEFRONT_TILE + (k-a-1)] = directions[a];
+            }
+        }
+
+        if(k > h && k - h <= w) {
+            wf->row[c0+k-h] = curr[h];
+        }
+        if(k > w && k - w <= h) {
+            wf->column[r0+k-w] = curr[k-w];
+        }
+
+        int *temp = prev2;
+        prev2 = prev;
+        prev = curr;
+        curr = temp;
+    }
+
+    // Pack the directions of each row of the tile, the partial byte at the left belongs to the tile tj == 0,
+    // together with column 0, and the one at the right to the last tile of the row
+    for(int a = 1; a <= h; a++) {
+        unsigned char *trace_row = wf->trace + (size_t)(r0+a) * wf->stride / 4;
+        unsigned char *directions_row = tile_trace + (a-1) * WAVEFRONT_TILE - (c0+1);
+        int j = c0 + 1;
+        for(; j <= c1 && j % 4 != 0; j++) {
+            set_trace(trace_row, j, directions_row[j]);
+        }
+        for(; j + 3 <= c1; j += 4) {
+            trace_row[j/4] = directions_row[j] | (directions_row[j+1] << 2) | (directions_row[j+2] << 4) | (directions_row[j+3] << 6);
+        }
+        for(; j <= c1; j++) {
+            set_trace(trace_row, j, directions_row[j]);
         }
-        printf("\n");
     }
+}
+
+// Cells a_first..a_last of an anti-diagonal, from the two previous ones. Both strings are indexed by a, so the
+// cells are independent and the loop is vectorized on 32 bit lanes, 16 bit lanes would overflow on long sequences
+void wavefront_cells(int *prev2, int *prev, int *curr, int *directions, char *y, char *x, int a_first, int a_last, int gap_cost, int mismatch_cost) {
+    int a = a_first;
+#if defined(__AVX2__)
+    __m256i gap = _mm256_set1_epi32(gap_cost);
+    __m256i mismatch = _mm256_set1_epi32(mismatch_cost);
+    __m256i one = _mm256_set1_epi32(1);
+    __m256i two = _mm256_set1_epi32(2);
+    for(; a + 7 <= a_last; a += 8) {
+        __m256i y_chars = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i *)(y + a)));
+        __m256i x_chars = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i *)(x + a)));
+        __m256i cost = _mm256_andnot_si256(_mm256_cmpeq_epi32(x_chars, y_chars), mismatch);
+        __m256i diag = _mm256_add_epi32(_mm256_loadu_si256((__m256i *)(prev2 + a - 1)), cost);
+        __m256i up = _mm256_add_epi32(_mm256_loadu_si256((__m256i *)(prev + a - 1)), gap);
+        __m256i left = _mm256_add_epi32(_mm256_loadu_si256((__m256i *)(prev + a)), gap);
+        __m256i best = _mm256_min_epi32(diag, _mm256_min_epi32(up, left));
+        // Same preference of the scalar code: diag, then up, then left
+        __m256i direction = _mm256_sub_epi32(two, _mm256_and_si256(_mm256_cmpeq_epi32(up, best), one));
+        direction = _mm256_andnot_si256(_mm256_cmpeq_epi32(diag, best), direction);
+        _mm256_storeu_si256((__m256i *)(curr + a), best);
+        _mm256_storeu_si256((__m256i *)(directions + a), direction);
+    }
+#elif defined(__SSE4_1__)
+    __m128i gap = _mm_set1_epi32(gap_cost);
+    __m128i mismatch = _mm_set1_epi32(mismatch_cost);
+    __m128i one = _mm_set1_epi32(1);
+    __m128i two = _mm_set1_epi32(2);
+    for(; a + 3 <= a_last; a += 4) {
+        int y_word, x_word;
+        memcpy(&y_word, y + a, sizeof(int));
+        memcpy(&x_word, x + a, sizeof(int));
+        __m128i y_chars = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(y_word));
+        __m128i x_chars = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(x_word));
+        __m128i cost = _mm_andnot_si128(_mm_cmpeq_epi32(x_chars, y_chars), mismatch);
+        __m128i diag = _mm_add_epi32(_mm_loadu_si128((__m128i *)(prev2 + a - 1)), cost);
+        __m128i up = _mm_add_epi32(_mm_loadu_si128((__m128i *)(prev + a - 1)), gap);
+        __m128i left = _mm_add_epi32(_mm_loadu_si128((__m128i *)(prev + a)), gap);
+        __m128i best = _mm_min_epi32(diag, _mm_min_epi32(up, left));
+        // Same preference of the scalar code: diag, then up, then left
+        __m128i direction = _mm_sub_epi32(two, _mm_and_si128(_mm_cmpeq_epi32(up, best), one));
+        direction = _mm_andnot_si128(_mm_cmpeq_epi32(diag, best), direction);
+        _mm_storeu_si128((__m128i *)(curr + a), best);
+        _mm_storeu_si128((__m128i *)(directions + a), direction);
+    }
+#endif
+    for(; a <= a_last; a++) {
+        int diag = prev2[a-1] + (x[a] == y[a] ? 0 : mismatch_cost);
+        int up = prev[a-1] + gap_cost;
+        int left = prev[a] + gap_cost;
+        int best = min(diag, min(up, left));
+        curr[a] = best;
+        directions[a] = diag == best ? TRACE_DIAG : (up == best ? TRACE_UP : TRACE_LEFT);
+    }
+}
+
+// Align all the pairs "x y" read one per line from input, printing "cost gaps mismatches" for each of them in input
+// order, followed by the alignment if with_alignment is set. Blank lines are skipped; returns -1, without aligning
+// anything, if a line has a single sequence. Pairs with the same lengths are aligned together, one per SIMD lane,
+// and the groups of pairs are shared among the threads with work stealing
+int find_alignments_batch(FILE *input, int num_threads, int with_alignment, int gap_cost, int mismatch_cost) {
+    struct batch batch;
+    batch.gap_cost = gap_cost;
+    batch.mismatch_cost = mismatch_cost;
+    batch.with_alignment = with_alignment;
+    batch.num_pairs = 0;
+
+    int capacity = 1024;
+    batch.x = malloc(sizeof(char *) * capacity);
+    batch.y = malloc(sizeof(char *) * capacity);
+    char *line = NULL;
+    size_t line_capacity = 0;
+    int line_number = 0;
+    while(getline(&line, &line_capacity, input) != -1) {
+        line_number++;
+        char *x = strtok(line, " \t\r\n");
+        if(x == NULL) {
+            // Blank lines, e.g. at the end of the file, have no pair
+            continue;
+        }
+        char *y = strtok(NULL, " \t\r\n");
+        if(y == NULL) {
+            // Skipping the line would shift all the following records
+            fprintf(stderr, "Line %d has a single sequence\n", line_number);
+            for(int p = 0; p < batch.num_pairs; p++) {
+                free(batch.x[p]);
+                free(batch.y[p]);
+            }
+            free(batch.x);
+            free(batch.y);
+            free(line);
+            return -1;
+        }
+        if(batch.num_pairs == capacity) {
+            capacity *= 2;
+            batch.x = realloc(batch.x, sizeof(char *) * capacity);
+            batch.y = realloc(batch.y, sizeof(char *) * capacity);
+        }
+        batch.x[batch.num_pairs] = strdup(x);
+        batch.y[batch.num_pairs] = strdup(y);
+        batch.num_pairs++;
+    }
+    free(line);
+
+    // Sort the pairs by lengths, then cut groups of at most BATCH_LANES pairs with the same lengths
+    struct batch_key *keys = malloc(sizeof(struct batch_key) * max(batch.num_pairs, 1));
+    for(int p = 0; p < batch.num_pairs; p++) {
+        keys[p].m = strlen(batch.x[p]);
+        keys[p].n = strlen(batch.y[p]);
+        keys[p].index = p;
+    }
+    qsort(keys, batch.num_pairs, sizeof(struct batch_key), compare_batch_keys);
+
+    batch.order = malloc(sizeof(int) * max(batch.num_pairs, 1));
+    batch.group_start = malloc(sizeof(int) * (batch.num_pairs + 1));
+    batch.num_groups = 0;
+    for(int p = 0; p < batch.num_pairs; p++) {
+        batch.order[p] = keys[p].index;
+        int start = batch.num_groups > 0 ? batch.group_start[batch.num_groups-1] : 0;
+        if(p == 0 || keys[p].m != keys[start].m || keys[p].n != keys[start].n || p - start == BATCH_LANES) {
+            batch.group_start[batch.num_groups++] = p;
+        }
+    }
+    batch.group_start[batch.num_groups] = batch.num_pairs;
+    free(keys);
+
+    // The groups are dealt round robin to the deques of the threads
+    batch.num_threads = max(1, min(num_threads, batch.num_groups));
+    batch.deques = malloc(sizeof(struct task_deque) * batch.num_threads);
+    for(int t = 0; t < batch.num_threads; t++) {
+        batch.deques[t].tasks = malloc(sizeof(int) * (batch.num_groups / batch.num_threads + 1));
+        batch.deques[t].head = 0;
+        batch.deques[t].tail = 0;
+        pthread_mutex_init(&batch.deques[t].lock, NULL);
+    }
+    for(int g = 0; g < batch.num_groups; g++) {
+        struct task_deque *deque = &batch.deques[g % batch.num_threads];
+        deque->tasks[deque->tail++] = g;
+    }
+
+    batch.results = malloc(sizeof(struct batch_result) * max(batch.num_pairs, 1));
+
+    struct batch_worker *workers = malloc(sizeof(struct batch_worker) * batch.num_threads);
+    for(int t = 0; t < batch.num_threads; t++) {
+        workers[t].batch = &batch;
+        workers[t].id = t;
+        if(t > 0) {
+            pthread_create(&workers[t].thread, NULL, run_batch_worker, &workers[t]);
+        }
+    }
+    run_batch_worker(&workers[0]);
+    for(int t = 1; t < batch.num_threads; t++) {
+        pthread_join(workers[t].thread, NULL);
+    }
+    free(workers);
+
+    for(int p = 0; p < batch.num_pairs; p++) {
+        struct batch_result *result = &batch.results[p];
+        if(with_alignment) {
+            printf("%d\t%d\t%d\t%s\t%s\n", result->cost, result->gaps, result->mismatches, result->x_align, result->y_align);
+            free(result->x_align);
+            free(result->y_align);
+        } else {
+            printf("%d\t%d\t%d\n", result->cost, result->gaps, result->mismatches);
+        }
+        free(batch.x[p]);
+        free(batch.y[p]);
+    }
+
+    for(int t = 0; t < batch.num_threads; t++) {
+        pthread_mutex_destroy(&batch.deques[t].lock);
+        free(batch.deques[t].tasks);
+    }
+    free(batch.deques);
+    free(batch.results);
+    free(batch.order);
+    free(batch.group_start);
+    free(batch.x);
+    free(batch.y);
+
+    return batch.num_pairs;
+}
+
+int compare_batch_keys(const void *a, const void *b) {
+    const struct batch_key *first = a;
+    const struct batch_key *second = b;
+    if(first->m != second->m) {
+        return first->m - second->m;
+    }
+    if(first->n != second->n) {
+        return first->n - second->n;
+    }
+    return first->index - second->index;
+}
+
+// Each thread takes the groups from the back of its own deque, and when it is empty steals from the front of the
+// other ones. No group is added after the start, so the thread stops when all the deques are empty
+void *run_batch_worker(void *arg) {
+    struct batch_worker *worker = arg;
+    struct batch *batch = worker->batch;
+
+    while(1) {
+        int group = -1;
+        struct task_deque *own = &batch->deques[worker->id];
+        pthread_mutex_lock(&own->lock);
+        if(own->head < own->tail) {
+            group = own->tasks[--own->tail];
+        }
+        pthread_mutex_unlock(&own->lock);
+
+        for(int t = 1; group == -1 && t < batch->num_threads; t++) {
+            struct task_deque *victim = &batch->deques[(worker->id + t) % batch->num_threads];
+            pthread_mutex_lock(&victim->lock);
+            if(victim->head < victim->tail) {
+                group = victim->tasks[victim->head++];
+            }
+            pthread_mutex_unlock(&victim->lock);
+        }
+
+        if(group == -1) {
+            break;
+        }
+        int start = batch->group_start[group];
+        align_group(batch, batch->order + start, batch->group_start[group+1] - start);
+    }
+
+    if(worker->id > 0) {
+        free_arena(&arena);
+    }
+    return NULL;
+}
+
+// Simple alignment of up to BATCH_LANES pairs with the same lengths, one per lane. The gaps and mismatches are
+// carried along the chosen moves, so they are the ones of the traceback without storing it
+void align_group(struct batch *batch, int *pairs, int size) {
+    int m = strlen(batch->x[pairs[0]]);
+    int n = strlen(batch->y[pairs[0]]);
+    int stride = trace_stride(m);
+    size_t lane_trace = (size_t)(n+1) * stride;
+    reserve_arena(&arena, (size_t)BATCH_LANES * (3 * (m+1) + m + n + 1), batch->with_alignment ? BATCH_LANES * lane_trace : 0);
+
+    // Lane l of cell j is at index j*BATCH_LANES+l, the unused lanes repeat the first pair
+    int *costs = arena.rows;
+    int *gaps = costs + BATCH_LANES * (m+1);
+    int *mismatches = gaps + BATCH_LANES * (m+1);
+    int *x_chars = mismatches + BATCH_LANES * (m+1);
+    int *y_chars = x_chars + BATCH_LANES * m;
+    int *directions = y_chars + BATCH_LANES * n;
+    for(int l = 0; l < BATCH_LANES; l++) {
+        char *x = batch->x[pairs[l < size ? l : 0]];
+        char *y = batch->y[pairs[l < size ? l : 0]];
+        for(int j = 0; j < m; j++) {
+            x_chars[j * BATCH_LANES + l] = (unsigned char)x[j];
+        }
+        for(int i = 0; i < n; i++) {
+            y_chars[i * BATCH_LANES + l] = (unsigned char)y[i];
+        }
+    }
+
+    lanes_t gap = lanes_set1(batch->gap_cost);
+    lanes_t mismatch = lanes_set1(batch->mismatch_cost);
+    lanes_t one = lanes_set1(1);
+    lanes_t two = lanes_set1(2);
+
+    for(int j = 0; j <= m; j++) {
+        lanes_store(costs + j * BATCH_LANES, lanes_set1(j * batch->gap_cost));
+        lanes_store(gaps + j * BATCH_LANES, lanes_set1(j));
+        lanes_store(mismatches + j * BATCH_LANES, lanes_set1(0));
+    }
+    if(batch->with_alignment) {
+        for(int l = 0; l < size; l++) {
+            unsigned char *trace = arena.trace + l * lane_trace / 4;
+            for(int j = 0; j <= m; j++) {
+                set_trace(trace, j, TRACE_LEFT);
+            }
+            for(int i = 1; i <= n; i++) {
+                set_trace(trace + (size_t)i * stride / 4, 0, TRACE_UP);
+            }
+        }
+    }
+
+    for(int i = 1; i <= n; i++) {
+        lanes_t y_lanes = lanes_load(y_chars + (i-1) * BATCH_LANES);
+        lanes_t diag_cost = lanes_load(costs);
+        lanes_t diag_gaps = lanes_load(gaps);
+        lanes_t diag_mismatches = lanes_load(mismatches);
+        lanes_t left_cost = lanes_set1(i * batch->gap_cost);
+        lanes_t left_gaps = lanes_set1(i);
+        lanes_t left_mismatches = lanes_set1(0);
+        lanes_store(costs, left_cost);
+        lanes_store(gaps, left_gaps);
+        lanes_store(mismatches, left_mismatches);
+
+        for(int j = 1; j <= m; j++) {
+            lanes_t up_cost = lanes_load(costs + j * BATCH_LANES);
+            lanes_t up_gaps = lanes_load(gaps + j * BATCH_LANES);
+            lanes_t up_mismatches = lanes_load(mismatches + j * BATCH_LANES);
+
+            lanes_t equal = lanes_eq(lanes_load(x_chars + (j-1) * BATCH_LANES), y_lanes);
+            lanes_t diag = lanes_add(diag_cost, lanes_andnot(equal, mismatch));
+            lanes_t up = lanes_add(up_cost, gap);
+            lanes_t left = lanes_add(left_cost, gap);
+            lanes_t best = lanes_min(diag, lanes_min(up, left));
+
+            // Same preference of the simple alignment: match or mismatch, then gap in x, then gap in y
+            lanes_t is_diag = lanes_eq(diag, best);
+            lanes_t is_up = lanes_eq(up, best);
+            lanes_t cell_gaps = lanes_select(is_diag, diag_gaps, lanes_add(lanes_select(is_up, up_gaps, left_gaps), one));
+            lanes_t cell_mismatches = lanes_select(is_diag, lanes_add(diag_mismatches, lanes_andnot(equal, one)),
+                lanes_select(is_up, up_mismatches, left_mismatches));
+
+            lanes_store(costs + j * BATCH_LANES, best);
+            lanes_store(gaps + j * BATCH_LANES, cell_gaps);
+            lanes_store(mismatches + j * BATCH_LANES, cell_mismatches);
+
+            if(batch->with_alignment) {
+                lanes_store(directions, lanes_andnot(is_diag, lanes_sub(two, lanes_and(is_up, one))));
+                for(int l = 0; l < size; l++) {
+                    set_trace(arena.trace + l * lane_trace / 4 + (size_t)i * stride / 4, j, directions[l]);
+                }
+            }
+
+            diag_cost = up_cost;
+            diag_gaps = up_gaps;
+            diag_mismatches = up_mismatches;
+            left_cost = best;
+            left_gaps = cell_gaps;
+            left_mismatches = cell_mismatches;
+        }
+    }
+
+    for(int l = 0; l < size; l++) {
+        struct batch_result *result = &batch->results[pairs[l]];
+        result->cost = costs[m * BATCH_LANES + l];
+        result->gaps = gaps[m * BATCH_LANES + l];
+        result->mismatches = mismatches[m * BATCH_LANES + l];
+        if(batch->with_alignment) {
+            int num_gaps, num_mismatches;
+            result->x_align = malloc(n + m + 1);
+            result->y_align = malloc(n + m + 1);
+            trace_back(arena.trace + l * lane_trace / 4, stride, NO_BAND, n, m, batch->x[pairs[l]], batch->y[pairs[l]],
+                result->x_align, result->y_align, &num_gaps, &num_mismatches);
+        }
+    }
+}
+
+#ifdef USE_MPI
+// Simple alignment with the columns of x split in blocks among the ranks. Each rank computes its block by tiles of
+// rows, receiving the column at its left from the previous rank and sending its last column to the next one, so
+// the ranks work as a pipeline along the rows. Only the left column and a row every about sqrt(n) rows are kept:
+// the traceback starts on the last rank and recomputes one segment of rows at a time from the checkpoints, until
+// the path reaches the left column and is handed to the previous rank
+int find_alignment_distributed(char *x, char *y, char *x_align, char *y_align, int gap_cost, int mismatch_cost) {
+    int m = strlen(x);
+    int n = strlen(y);
+    int rank, num_ranks;
+    exit_on_fail(MPI_Comm_rank(MPI_COMM_WORLD, &rank));
+    exit_on_fail(MPI_Comm_size(MPI_COMM_WORLD, &num_ranks));
+
+    // With fewer columns than ranks, the last ones have no block
+    int active = max(1, min(num_ranks, m));
+    int c0 = rank < active ? (int)((long)rank * m / active) : m;
+    int c1 = rank < active ? (int)((long)(rank+1) * m / active) : m;
+    int w = c1 - c0;
+
+    int checkpoint_rows = 1;
+    while(checkpoint_rows * checkpoint_rows < n) {
+        checkpoint_rows++;
+    }
+
+    int cost = 0;
+    int num_gaps = 0;
+    int num_mismatches = 0;
+    char *x_piece = malloc(n + w + 1);
+    char *y_piece = malloc(n + w + 1);
+    int k = 0;
+
+    if(rank < active) {
+        int *left = malloc(sizeof(int) * (n+1));
+        int *row = malloc(sizeof(int) * (w+1));
+        int *checkpoints = malloc(sizeof(int) * (size_t)(n / checkpoint_rows + 1) * (w+1));
+        int *send_buffers = malloc(sizeof(int) * 2 * DISTRIBUTED_TILE);
+        MPI_Request send_requests[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+        MPI_Request receive_request = MPI_REQUEST_NULL;
+
+        // Only the first rank knows its left column, column 0
+        for(int i = 0; i <= n; i++) {
+            left[i] = i * gap_cost;
+        }
+        left[0] = c0 * gap_cost;
+        for(int t = 0; t <= w; t++) {
+            row[t] = (c0 + t) * gap_cost;
+        }
+        memcpy(checkpoints, row, sizeof(int) * (w+1));
+
+        if(rank > 0 && n > 0) {
+            exit_on_fail(MPI_Irecv(left + 1, min(DISTRIBUTED_TILE, n), MPI_INT, rank-1, 0, MPI_COMM_WORLD, &receive_request));
+        }
+        for(int r0 = 0, tile = 0; r0 < n; r0 += DISTRIBUTED_TILE, tile++) {
+            int r1 = min(r0 + DISTRIBUTED_TILE, n);
+
+            // The left column of the next tile is received while this one is computed
+            if(rank > 0) {
+                exit_on_fail(MPI_Wait(&receive_request, MPI_STATUS_IGNORE));
+                if(r1 < n) {
+                    exit_on_fail(MPI_Irecv(left + r1 + 1, min(DISTRIBUTED_TILE, n - r1), MPI_INT, rank-1, 0, MPI_COMM_WORLD, &receive_request));
+                }
+            }
+
+            int *send_buffer = send_buffers + (tile % 2) * DISTRIBUTED_TILE;
+            exit_on_fail(MPI_Wait(&send_requests[tile % 2], MPI_STATUS_IGNORE));
+            for(int i = r0 + 1; i <= r1; i++) {
+                fill_block_row(x, y, i, c0, w, left[i], row, NULL, gap_cost, mismatch_cost);
+                send_buffer[i - r0 - 1] = row[w];
+                if(i % checkpoint_rows == 0) {
+                    memcpy(checkpoints + (size_t)(i / checkpoint_rows) * (w+1), row, sizeof(int) * (w+1));
+                }
+            }
+            if(rank < active - 1) {
+                exit_on_fail(MPI_Isend(send_buffer, r1 - r0, MPI_INT, rank+1, 0, MPI_COMM_WORLD, &send_requests[tile % 2]));
+            }
+        }
+        exit_on_fail(MPI_Waitall(2, send_requests, MPI_STATUSES_IGNORE));
+        cost = row[w];
+
+        // The path enters the block from the right at row i, and leaves it at the left column
+        int i = n;
+        int j = c1;
+        if(rank < active - 1) {
+            exit_on_fail(MPI_Recv(&i, 1, MPI_INT, rank+1, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE));
+        }
+        int stride = trace_stride(w);
+        unsigned char *segment = malloc((size_t)(checkpoint_rows + 1) * stride / 4);
+        while(j > c0) {
+            if(i == 0) {
+                // Gap in y
+                x_piece[k] = x[j-1];
+                y_piece[k] = '-';
+                num_gaps++;
+                j--;
+                k++;
+                continue;
+            }
+
+            // Recompute the rows after the checkpoint above row i, with their traceback directions
+            int top = (i-1) / checkpoint_rows * checkpoint_rows;
+            memcpy(row, checkpoints + (size_t)(top / checkpoint_rows) * (w+1), sizeof(int) * (w+1));
+            for(int a = top + 1; a <= i; a++) {
+                fill_block_row(x, y, a, c0, w, left[a], row, segment + (size_t)(a - top) * stride / 4, gap_cost, mismatch_cost);
+            }
+
+            while(i > top && j > c0) {
+                int direction = get_trace(segment, (size_t)(i - top) * stride + (j - c0));
+                if (direction == TRACE_DIAG) {
+                    if(x[j-1] == y[i-1]) {
+                        x_piece[k] = x[j-1];
+                        y_piece[k] = y[i-1];
+                    } else {
+                        x_piece[k] = '*';
+                        y_piece[k] = '*';
+                        num_mismatches++;
+                    }
+                    i--;
+                    j--;
+                } else if (direction == TRACE_UP) {
+                    x_piece[k] = '-';
+                    y_piece[k] = y[i-1];
+                    num_gaps++;
+                    i--;
+                } else {
+                    x_piece[k] = x[j-1];
+                    y_piece[k] = '-';
+                    num_gaps++;
+                    j--;
+                }
+                k++;
+            }
+        }
+        if(rank > 0) {
+            exit_on_fail(MPI_Send(&i, 1, MPI_INT, rank-1, 1, MPI_COMM_WORLD));
+        } else {
+            // Column 0 is reached only with gaps in x
+            for(; i > 0; i--, k++) {
+                x_piece[k] = '-';
+                y_piece[k] = y[i-1];
+                num_gaps++;
+            }
+        }
+
+        free(segment);
+        free(left);
+        free(row);
+        free(checkpoints);
+        free(send_buffers);
+    }
+
+    // Each piece was written backwards, reversed they follow in rank order
+    for(int a = 0; a < k/2; a++) {
+        char temp = x_piece[a];
+        x_piece[a] = x_piece[k-a-1];
+        x_piece[k-a-1] = temp;
+        temp = y_piece[a];
+        y_piece[a] = y_piece[k-a-1];
+        y_piece[k-a-1] = temp;
+    }
+
+    int *lengths = malloc(sizeof(int) * num_ranks);
+    int *offsets = malloc(sizeof(int) * num_ranks);
+    exit_on_fail(MPI_Gather(&k, 1, MPI_INT, lengths, 1, MPI_INT, 0, MPI_COMM_WORLD));
+    int length = 0;
+    if(rank == 0) {
+        for(int r = 0; r < num_ranks; r++) {
+            offsets[r] = length;
+            length += lengths[r];
+        }
+    }
+    exit_on_fail(MPI_Gatherv(x_piece, k, MPI_CHAR, x_align, lengths, offsets, MPI_CHAR, 0, MPI_COMM_WORLD));
+    exit_on_fail(MPI_Gatherv(y_piece, k, MPI_CHAR, y_align, lengths, offsets, MPI_CHAR, 0, MPI_COMM_WORLD));
+
+    int counts[2] = {num_gaps, num_mismatches};
+    int totals[2] = {0, 0};
+    exit_on_fail(MPI_Reduce(counts, totals, 2, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD));
+    exit_on_fail(MPI_Bcast(&cost, 1, MPI_INT, active - 1, MPI_COMM_WORLD));
+
+    if(rank == 0) {
+        x_align[length] = '\0';
+        y_align[length] = '\0';
+        printf("Mismatches: %d, Gaps: %d, Cost: %d\n", totals[1], totals[0], cost);
+    }
+
+    free(lengths);
+    free(offsets);
+    free(x_piece);
+    free(y_piece);
+
+    return cost;
+}
+
+// Row i of the block of columns c0..c0+w, from row i-1 in row and the left column value, with the same preference
+// of the simple alignment. The traceback directions of the columns after c0 are stored in trace, if given
+void fill_block_row(char *x, char *y, int i, int c0, int w, int left, int *row, unsigned char *trace, int gap_cost, int mismatch_cost) {
+    int diag = row[0];
+    row[0] = left;
+    for(int t = 1; t <= w; t++) {
+        int d = diag + (x[c0+t-1] == y[i-1] ? 0 : mismatch_cost);
+        int up = row[t] + gap_cost;
+        int l = row[t-1] + gap_cost;
+        int best = min(d, min(up, l));
+        diag = row[t];
+        row[t] = best;
+        if(trace != NULL) {
+            set_trace(trace, t, d == best ? TRACE_DIAG : (up == best ? TRACE_UP : TRACE_LEFT));
+        }
+    }
+}
+
+// the input parameter is the return code of an MPI function. If this value is not equal to MPI_SUCCESS, it prints
+// on the standard error the error class and its explanation, and aborts all the ranks
+void exit_on_fail(int return_code) {
+    if (return_code == MPI_SUCCESS) {
+        return;
+    }
+
+    int error_class = MPI_ERR_UNKNOWN;
+    if (MPI_Error_class(return_code, &error_class) != MPI_SUCCESS) {
+        error_class = MPI_ERR_UNKNOWN;
+    }
+
+    char explanation[MPI_MAX_ERROR_STRING] = "Explanation not available";
+    int explanation_len = 0;
+    if (MPI_Error_string(return_code, explanation, &explanation_len) == MPI_SUCCESS) {
+        explanation[explanation_len] = '\0';
+    }
+
+    fprintf(stderr, "MPI error %d: \"%s\"\n", error_class, explanation);
+    MPI_Abort(MPI_COMM_WORLD, return_code);
+}
+#endif
+
+// Exhaustive search of the pair x, y of lengths n and m over alphabet with the maximum cost of the simple alignment.
+// Renaming the letters does not change the cost, so only the y where each letter first appears after the previous
+// ones are tried. For each of them the x are explored as a trie, each node computing its dp row from the one of its
+// parent, and a subtree is skipped when even its best completion cannot beat the best cost found so far
+int search_maximum_cost_strings(int n, int m, char *alphabet, int num_threads, int gap_cost, int mismatch_cost) {
+    struct search search;
+    search.n = n;
+    search.m = m;
+    search.gap_cost = gap_cost;
+    search.mismatch_cost = mismatch_cost;
+    search.alphabet = alphabet;
+    search.alphabet_size = strlen(alphabet);
+    search.best_x = calloc(n + 1, sizeof(char));
+    search.best_y = calloc(m + 1, sizeof(char));
+    atomic_init(&search.best_cost, -1);
+    atomic_init(&search.next_prefix, 0);
+    search.nodes = 0;
+    pthread_mutex_init(&search.lock, NULL);
+
+    // No pair costs more than aligning all the letters of the shorter string with the cheaper of a mismatch or two
+    // gaps, so the search stops as soon as a pair reaches it
+    search.ceiling = min(n, m) * min(mismatch_cost, 2 * gap_cost) + abs(n - m) * gap_cost;
+
+    // The threads take the prefixes of y from a shared counter, the prefixes are long enough to be a few per thread
+    search.prefix_length = 0;
+    while(search.prefix_length < m && count_canonical_prefixes(search.prefix_length, search.alphabet_size) < 16 * num_threads) {
+        search.prefix_length++;
+    }
+    search.num_prefixes = count_canonical_prefixes(search.prefix_length, search.alphabet_size);
+    search.prefixes = malloc(search.num_prefixes * (search.prefix_length + 1));
+    char *prefix = malloc(search.prefix_length + 1);
+    int num_prefixes = 0;
+    list_canonical_prefixes(&search, prefix, 0, 0, &num_prefixes);
+    free(prefix);
+
+    num_threads = max(1, min(num_threads, search.num_prefixes));
+    pthread_t *threads = malloc(sizeof(pthread_t) * num_threads);
+    for(int t = 1; t < num_threads; t++) {
+        pthread_create(&threads[t], NULL, run_search_worker, &search);
+    }
+    run_search_worker(&search);
+    for(int t = 1; t < num_threads; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    free(threads);
+
+    int cost = atomic_load(&search.best_cost);
+    printf("Explored %ld nodes\n", search.nodes);
+    printf("The maximum cost is: %d\n", cost);
+    printf("\nThe strings with maximum cost alignment are:\n");
+    printf("\t%s\n", search.best_x);
+    printf("\t%s\n", search.best_y);
+
+    // The pattern of generate_maximum_cost_strings has the shorter string at least 4 letters long
+    if(min(n, m) >= 4) {
+        char *x = calloc(max(n, m) + 1, sizeof(char));
+        char *y = calloc(max(n, m) + 1, sizeof(char));
+        fill_maximum_cost_pattern(n, m, x, y);
+        int pattern_cost = alignment_cost(x, y, gap_cost, mismatch_cost);
+        printf("\nThe hard-coded pattern %s, %s costs %d, %s\n", x, y, pattern_cost,
+            pattern_cost == cost ? "the maximum" : "less than the maximum");
+        free(x);
+        free(y);
+    }
+
+    pthread_mutex_destroy(&search.lock);
+    free(search.prefixes);
+    free(search.best_x);
+    free(search.best_y);
+
+    return cost;
+}
+
+void *run_search_worker(void *arg) {
+    struct search *search = arg;
+    int n = search->n;
+    int m = search->m;
+    int *rows = malloc(sizeof(int) * (n+1) * (m+1));
+    char *x = calloc(n + 1, sizeof(char));
+    char *y = calloc(m + 1, sizeof(char));
+    long nodes = 0;
+
+    for(int j = 0; j <= m; j++) {
+        rows[j] = j * search->gap_cost;
+    }
+
+    int p;
+    while((p = atomic_fetch_add(&search->next_prefix, 1)) < search->num_prefixes && atomic_load(&search->best_cost) < search->ceiling) {
+        char *prefix = search->prefixes + (size_t)p * (search->prefix_length + 1);
+        memcpy(y, prefix, search->prefix_length);
+        search_y(search, y, search->prefix_length, prefix[search->prefix_length], rows, x, &nodes);
+    }
+
+    pthread_mutex_lock(&search->lock);
+    search->nodes += nodes;
+    pthread_mutex_unlock(&search->lock);
+
+    free(rows);
+    free(x);
+    free(y);
+    return NULL;
+}
+
+// Number of strings of the given length where each letter first appears after the previous ones
+long count_canonical_prefixes(int length, int alphabet_size) {
+    // counts[u] is the number of those strings using u letters
+    long counts[256] = {1};
+    for(int i = 0; i < length; i++) {
+        for(int used = min(i + 1, alphabet_size); used >= 1; used--) {
+            counts[used] = counts[used] * used + counts[used-1];
+        }
+        counts[0] = 0;
+    }
+    long total = 0;
+    for(int used = 0; used <= alphabet_size; used++) {
+        total += counts[used];
+    }
+    return total;
+}
+
+// Each prefix is stored followed by the number of letters it uses
+void list_canonical_prefixes(struct search *search, char *prefix, int length, int used, int *num_prefixes) {
+    if(length == search->prefix_length) {
+        char *slot = search->prefixes + (size_t)(*num_prefixes)++ * (length + 1);
+        memcpy(slot, prefix, length);
+        slot[length] = used;
+        return;
+    }
+    for(int c = 0; c <= used && c < search->alphabet_size; c++) {
+        prefix[length] = search->alphabet[c];
+        list_canonical_prefixes(search, prefix, length + 1, max(used, c + 1), num_prefixes);
+    }
+}
+
+void search_y(struct search *search, char *y, int length, int used, int *rows, char *x, long *nodes) {
+    if(length == search->m) {
+        search_x(search, x, y, 0, rows, nodes);
+        return;
+    }
+    for(int c = 0; c <= used && c < search->alphabet_size && atomic_load(&search->best_cost) < search->ceiling; c++) {
+        y[length] = search->alphabet[c];
+        search_y(search, y, length + 1, max(used, c + 1), rows, x, nodes);
+    }
+}
+
+// Row k of rows is the dp row of the first k letters of x against y. Completing x with r more letters costs at most
+// H[k][j] + min(r, s)·min(mismatch_cost, 2·gap_cost) + |r-s|·gap_cost for every j, with s = m-j letters left in y
+void search_x(struct search *search, char *x, char *y, int k, int *rows, long *nodes) {
+    int n = search->n;
+    int m = search->m;
+    int gap_cost = search->gap_cost;
+    int *prev = rows + (size_t)k * (m+1);
+
+    if(k == n) {
+        if(prev[m] > atomic_load(&search->best_cost)) {
+            pthread_mutex_lock(&search->lock);
+            if(prev[m] > atomic_load(&search->best_cost)) {
+                atomic_store(&search->best_cost, prev[m]);
+                memcpy(search->best_x, x, n);
+                memcpy(search->best_y, y, m);
+            }
+            pthread_mutex_unlock(&search->lock);
+        }
+        return;
+    }
+
+    int *curr = prev + (m+1);
+    int r = n - k - 1;
+    int substitution = min(search->mismatch_cost, 2 * gap_cost);
+    for(int c = 0; c < search->alphabet_size; c++) {
+        x[k] = search->alphabet[c];
+        (*nodes)++;
+
+        curr[0] = prev[0] + gap_cost;
+        int bound = curr[0] + min(r, m) * substitution + abs(r - m) * gap_cost;
+        for(int j = 1; j <= m; j++) {
+            curr[j] = min(
+                min(
+                    prev[j] + gap_cost,
+                    curr[j-1] + gap_cost
+                    ),
+                prev[j-1] + (x[k] == y[j-1] ? 0 : search->mismatch_cost));
+            int s = m - j;
+            bound = min(bound, curr[j] + min(r, s) * substitution + abs(r - s) * gap_cost);
+        }
+
+        if(bound > atomic_load(&search->best_cost) && atomic_load(&search->best_cost) < search->ceiling) {
+            search_x(search, x, y, k + 1, rows, nodes);
+        }
+    }
+}
+
+// BLOSUM62 scores, converted to costs by load_scoring
+static const signed char blosum62[24][24] = {
+    { 4, -1, -2, -2,  0, -1, -1,  0, -2, -1, -1, -1, -1, -2, -1,  1,  0, -3, -2,  0, -2, -1,  0, -4},
+    {-1,  5,  0, -2, -3,  1,  0, -2,  0, -3, -2,  2, -1, -3, -2, -1, -1, -3, -2, -3, -1,  0, -1, -4},
+    {-2,  0,  6,  1, -3,  0,  0,  0,  1, -3, -3,  0, -2, -3, -2,  1,  0, -4, -2, -3,  3,  0, -1, -4},
+    {-2, -2,  1,  6, -3,  0,  2, -1, -1, -3, -4, -1, -3, -3, -1,  0, -1, -4, -3, -3,  4,  1, -1, -4},
+    { 0, -3, -3, -3,  9, -3, -4, -3, -3, -1, -1, -3, -1, -2, -3, -1, -1, -2, -2, -1, -3, -3, -2, -4},
+    {-1,  1,  0,  0, -3,  5,  2, -2,  0, -3, -2,  1,  0, -3, -1,  0, -1, -2, -1, -2,  0,  3, -1, -4},
+    {-1,  0,  0,  2, -4,  2,  5, -2,  0, -3, -3,  1, -2, -3, -1,  0, -1, -3, -2, -2,  1,  4, -1, -4},
+    { 0, -2,  0, -1, -3, -2, -2,  6, -2, -4, -4, -2, -3, -3, -2,  0, -2, -2, -3, -3, -1, -2, -1, -4},
+    {-2,  0,  1, -1, -3,  0,  0, -2,  8, -3, -3, -1, -2, -1, -2, -1, -2, -2,  2, -3,  0,  0, -1, -4},
+    {-1, -3, -3, -3, -1, -3, -3, -4, -3,  4,  2, -3,  1,  0, -3, -2, -1, -3, -1,  3, -3, -3, -1, -4},
+    {-1, -2, -3, -4, -1, -2, -3, -4, -3,  2,  4, -2,  2,  0, -3, -2, -1, -2, -1,  1, -4, -3, -1, -4},
+    {-1,  2,  0, -1, -3,  1,  1, -2, -1, -3, -2,  5, -1, -3, -1,  0, -1, -3, -2, -2,  0,  1, -1, -4},
+    {-1, -1, -2, -3, -1,  0, -2, -3, -2,  1,  2, -1,  5,  0, -2, -1, -1, -1, -1,  1, -3, -1, -1, -4},
+    {-2, -3, -3, -3, -2, -3, -3, -3, -1,  0,  0, -3,  0,  6, -4, -2, -2,  1,  3, -1, -3, -3, -1, -4},
+    {-1, -2, -2, -1, -3, -1, -1, -2, -2, -3, -3, -1, -2, -4,  7, -1, -1, -4, -3, -2, -2, -1, -2, -4},
+    { 1, -1,  1,  0, -1,  0,  0,  0, -1, -2, -2,  0, -1, -2, -1,  4,  1, -3, -2, -2,  0,  0,  0, -4},
+    { 0, -1,  0, -1, -1, -1, -1, -2, -2, -1, -1, -1, -1, -2, -1,  1,  5, -2, -2,  0, -1, -1,  0, -4},
+    {-3, -3, -4, -4, -2, -2, -3, -2, -2, -3, -2, -3, -1,  1, -4, -3, -2, 11,  2, -3, -4, -3, -2, -4},
+    {-2, -2, -2, -3, -2, -1, -2, -3,  2, -1, -1, -2, -1,  3, -3, -2, -2,  2,  7, -1, -3, -2, -1, -4},
+    { 0, -3, -3, -3, -1, -2, -2, -3, -3,  3,  1, -2,  1, -1, -2, -2,  0, -3, -1,  4, -3, -2, -1, -4},
+    {-2, -1,  3,  4, -3,  0,  1, -1,  0, -3, -4,  0, -3, -3, -2,  0, -1, -4, -3, -3,  4,  1, -1, -4},
+    {-1,  0,  0,  1, -3,  3,  4, -2,  0, -3, -3,  1, -1, -3, -1,  0, -1, -3, -2, -2,  1,  4, -1, -4},
+    { 0, -1, -1, -1, -2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -2,  0,  0, -2, -1, -1, -1, -1, -1, -4},
+    {-4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4,  1},
+};
+
+// Scoring for -affine: a gap of length L costs gap_open + L*gap_extend, and aligning letter a of x with letter b
+// of y costs matrix[code[b] * alphabet_size + code[a]], so that the dp reads a single row for each letter of y. The
+// presets are dna, i.e. the costs of -simple, and protein, i.e. BLOSUM62; any other name is a file with the
+// alphabet on the first line and then its matrix of costs, with a row for each letter of x and a column for each
+// letter of y, lines starting with # are skipped
+int load_scoring(struct scoring *scoring, char *name, int gap_open, int gap_extend) {
+    scoring->gap_open = gap_open;
+    scoring->gap_extend = gap_extend;
+    for(int c = 0; c < 256; c++) {
+        scoring->code[c] = -1;
+    }
+
+    char *alphabet;
+    char *line = NULL;
+    size_t line_capacity = 0;
+    FILE *input = NULL;
+    int protein = strcmp(name, "protein") == 0;
+    if(strcmp(name, "dna") == 0) {
+        alphabet = "ACGT";
+    } else if(protein) {
+        alphabet = BLOSUM62_ALPHABET;
+    } else {
+        input = fopen(name, "r");
+        if(input == NULL) {
+            printf("Cannot open %s\n", name);
+            return -1;
+        }
+        alphabet = NULL;
+        while(alphabet == NULL && getline(&line, &line_capacity, input) != -1) {
+            if(line[0] != '#') {
+                alphabet = strtok(line, " \t\r\n");
+            }
+        }
+        if(alphabet == NULL) {
+            printf("No alphabet in %s\n", name);
+            fclose(input);
+            free(line);
+            return -1;
+        }
+    }
+
+    int size = strlen(alphabet);
+    scoring->alphabet_size = size;
+    scoring->matrix = malloc(sizeof(int) * size * size);
+    for(int a = 0; a < size; a++) {
+        scoring->code[(unsigned char)alphabet[a]] = a;
+    }
+
+    for(int a = 0; a < size; a++) {
+        for(int b = 0; b < size; b++) {
+            // Transposed, the rows of the file are the letters of x
+            int *cost = &scoring->matrix[b * size + a];
+            if(input != NULL) {
+                if(fscanf(input, "%d", cost) != 1) {
+                    printf("The matrix in %s needs %d costs\n", name, size * size);
+                    fclose(input);
+                    free(line);
+                    free(scoring->matrix);
+                    return -1;
+                }
+            } else if(protein) {
+                // A score is higher for more similar letters, the cost is how much lower it is than the mean of the
+                // scores of the two letters with themselves, so that a match costs 0
+                *cost = (blosum62[a][a] + blosum62[b][b]) / 2 - blosum62[a][b];
+            } else {
+                *cost = a == b ? MATCH_COST : MISMATCH_COST;
+            }
+        }
+    }
+    if(input != NULL) {
+        fclose(input);
+        free(line);
+    }
+
+    // A matrix with free matches and a single cost for all the mismatches needs no lookup
+    scoring->uniform = 1;
+    scoring->mismatch_cost = size > 1 ? scoring->matrix[1] : 0;
+    for(int a = 0; a < size; a++) {
+        for(int b = 0; b < size; b++) {
+            if(scoring->matrix[a * size + b] != (a == b ? 0 : scoring->mismatch_cost)) {
+                scoring->uniform = 0;
+            }
+        }
+    }
+
+    return 0;
+}
+
+// Alignment with the given scoring. Each combination of linear or affine gaps and uniform or general matrix has its
+// own kernel, and linear gaps with a uniform matrix are the simple alignment
+int find_alignment_affine(char *x, char *y, char *x_align, char *y_align, struct scoring *scoring) {
+    int m = strlen(x);
+    int n = strlen(y);
+    for(char *c = x; *c != '\0'; c++) {
+        if(scoring->code[(unsigned char)*c] < 0) {
+            printf("Letter %c is not in the alphabet of the scoring\n", *c);
+            return UNREACHABLE;
+        }
+    }
+    for(char *c = y; *c != '\0'; c++) {
+        if(scoring->code[(unsigned char)*c] < 0) {
+            printf("Letter %c is not in the alphabet of the scoring\n", *c);
+            return UNREACHABLE;
+        }
+    }
+
+    int cost;
+    int num_gaps, num_mismatches;
+    if(scoring->gap_open == 0 && scoring->uniform) {
+        cost = fill_simple(x, y, scoring->gap_extend, scoring->mismatch_cost, 0);
+        trace_back(arena.trace, trace_stride(m), NO_BAND, n, m, x, y, x_align, y_align, &num_gaps, &num_mismatches);
+    } else {
+        int state = TRACE_DIAG;
+        if(scoring->gap_open == 0) {
+            cost = fill_linear_matrix(scoring, x, y, &state);
+        } else if(scoring->uniform) {
+            cost = fill_affine_uniform(scoring, x, y, &state);
+        } else {
+            cost = fill_affine_matrix(scoring, x, y, &state);
+        }
+        trace_back_scored(arena.trace, n, m, x, y, x_align, y_align, scoring->gap_open != 0, state, &num_gaps, &num_mismatches);
+    }
+
+    printf("Mismatches: %d, Gaps: %d, Cost: %d\n", num_mismatches, num_gaps, cost);
+
+    return cost;
+}
+
+// Index of the minimum of the costs of the three states, with the same preference of the simple alignment
+static inline __attribute__((always_inline)) int min_state(int diag, int up, int left) {
+    return diag <= up && diag <= left ? TRACE_DIAG : (up <= left ? TRACE_UP : TRACE_LEFT);
+}
+
+// Gotoh's dp with three states: the alignments ending with a match or mismatch (M), with a gap in x (X) and with a
+// gap in y (Y). Each cell stores one byte in the arena, with the state of the previous cell for each of the three
+// states in bits 0-1, 2-3 and 4-5; with linear gaps a single state is kept, and the byte is its direction.
+// affine and uniform are constants in each caller, so the compiler removes the branches on them
+static inline __attribute__((always_inline)) int fill_scored(struct scoring *scoring, char *x, char *y, const int affine, const int uniform, int *end_state) {
+    int m = strlen(x);
+    int n = strlen(y);
+    int width = m + 1;
+    reserve_arena(&arena, 6 * width + m, 4 * (size_t)(n+1) * width);
+
+    int *m_prev = arena.rows;
+    int *x_prev = m_prev + width;
+    int *y_prev = x_prev + width;
+    int *m_curr = y_prev + width;
+    int *x_curr = m_curr + width;
+    int *y_curr = x_curr + width;
+    int *x_codes = y_curr + width;
+    unsigned char *trace = arena.trace;
+
+    int extend = scoring->gap_extend;
+    int open_extend = scoring->gap_open + extend;
+    int mismatch_cost = scoring->mismatch_cost;
+    int size = scoring->alphabet_size;
+    if(!uniform) {
+        for(int j = 0; j < m; j++) {
+            x_codes[j] = scoring->code[(unsigned char)x[j]];
+        }
+    }
+
+    m_curr[0] = 0;
+    x_curr[0] = INFINITE_COST;
+    y_curr[0] = INFINITE_COST;
+    trace[0] = 0;
+    for(int j = 1; j <= m; j++) {
+        if(affine) {
+            m_curr[j] = INFINITE_COST;
+            x_curr[j] = INFINITE_COST;
+            y_curr[j] = scoring->gap_open + j * extend;
+            trace[j] = (j == 1 ? TRACE_DIAG : TRACE_LEFT) << 4;
+        } else {
+            m_curr[j] = j * extend;
+            trace[j] = TRACE_LEFT;
+        }
+    }
+
+    for(int i = 1; i <= n; i++) {
+        int *temp = m_prev;
+        m_prev = m_curr;
+        m_curr = temp;
+        temp = x_prev;
+        x_prev = x_curr;
+        x_curr = temp;
+        temp = y_prev;
+        y_prev = y_curr;
+        y_curr = temp;
+        unsigned char *trace_row = trace + (size_t)i * width;
+        int *substitution = uniform ? NULL : scoring->matrix + scoring->code[(unsigned char)y[i-1]] * size;
+
+        if(affine) {
+            m_curr[0] = INFINITE_COST;
+            x_curr[0] = scoring->gap_open + i * extend;
+            y_curr[0] = INFINITE_COST;
+            trace_row[0] = (i == 1 ? TRACE_DIAG : TRACE_UP) << 2;
+        } else {
+            m_curr[0] = i * extend;
+            trace_row[0] = TRACE_UP;
+        }
+
+        for(int j = 1; j <= m; j++) {
+            int cost = uniform ? (x[j-1] == y[i-1] ? 0 : mismatch_cost) : substitution[x_codes[j-1]];
+            if(affine) {
+                // M from (i-1, j-1), X from (i-1, j) and Y from (i, j-1)
+                int m_state = min_state(m_prev[j-1], x_prev[j-1], y_prev[j-1]);
+                int x_state = min_state(m_prev[j] + open_extend, x_prev[j] + extend, y_prev[j] + open_extend);
+                int y_state = min_state(m_curr[j-1] + open_extend, x_curr[j-1] + open_extend, y_curr[j-1] + extend);
+                m_curr[j] = min(m_prev[j-1], min(x_prev[j-1], y_prev[j-1])) + cost;
+                x_curr[j] = min(m_prev[j] + open_extend, min(x_prev[j] + extend, y_prev[j] + open_extend));
+                y_curr[j] = min(m_curr[j-1] + open_extend, min(x_curr[j-1] + open_extend, y_curr[j-1] + extend));
+                trace_row[j] = m_state | (x_state << 2) | (y_state << 4);
+            } else {
+                int diag = m_prev[j-1] + cost;
+                int up = m_prev[j] + extend;
+                int left = m_curr[j-1] + extend;
+                m_curr[j] = min(diag, min(up, left));
+                trace_row[j] = min_state(diag, up, left);
+            }
+        }
+    }
+
+    if(!affine) {
+        return m_curr[m];
+    }
+    *end_state = min_state(m_curr[m], x_curr[m], y_curr[m]);
+    return min(m_curr[m], min(x_curr[m], y_curr[m]));
+}
+
+int fill_linear_matrix(struct scoring *scoring, char *x, char *y, int *end_state) {
+    return fill_scored(scoring, x, y, 0, 0, end_state);
+}
+
+int fill_affine_uniform(struct scoring *scoring, char *x, char *y, int *end_state) {
+    return fill_scored(scoring, x, y, 1, 1, end_state);
+}
+
+int fill_affine_matrix(struct scoring *scoring, char *x, char *y, int *end_state) {
+    return fill_scored(scoring, x, y, 1, 0, end_state);
+}
+
+// Same as trace_back for the bytes of fill_scored. With affine gaps, the move is given by the current state, and
+// the byte of the cell gives the state of the previous one
+int trace_back_scored(unsigned char *trace, int n, int m, char *x, char *y, char *x_align, char *y_align, int affine, int state, int *num_gaps, int *num_mismatches) {
+    int i = n;
+    int j = m;
+    int k = 0;
+    *num_mismatches = 0;
+    *num_gaps = 0;
+
+    while (i > 0 || j > 0) {
+        unsigned char cell = trace[(size_t)i * (m+1) + j];
+        int direction = affine ? state : cell;
+        state = (cell >> (2 * state)) & 3;
+        if (direction == TRACE_DIAG) {
+            if(x[j-1] == y[i-1]) {
+                // Match
+                x_align[k] = x[j-1];
+                y_align[k] = y[i-1];
+            } else {
+                // Mismatch
+                x_align[k] = '*';
+                y_align[k] = '*';
+                (*num_mismatches)++;
+            }
+            i--;
+            j--;
+        } else if (direction == TRACE_UP) {
+            // Gap in x
+            x_align[k] = '-';
+            y_align[k] = y[i-1];
+            (*num_gaps)++;
+            i--;
+        } else {
+            // Gap in y
+            x_align[k] = x[j-1];
+            y_align[k] = '-';
+            (*num_gaps)++;
+            j--;
+        }
+        k++;
+    }
+
+    for(int i = 0; i<k/2; i++) {
+        char temp = x_align[i];
+        x_align[i] = x_align[k-i-1];
+        x_align[k-i-1] = temp;
+    }
+    for(int i = 0; i<k/2; i++) {
+        char temp = y_align[i];
+        y_align[i] = y_align[k-i-1];
+        y_align[k-i-1] = temp;
+    }
+    x_align[k] = '\0';
+    y_align[k] = '\0';
+
+    return k;
+}
+
+void print_table_header(int m, char *x) {
+    printf("       |");
+    for(int i = 0; i<m; i++) {
+        printf("%3c|", x[i]);
+    }
+    printf("\n");
+    for(int i = 0; i<=m; i++) {
+        printf("-----");
+    }
+    printf("\n");
+}
+
+// The rows can be printed as soon as they are computed, so the table does not need to be kept
+// Cells outside the band are printed as unreachable
+void print_band_row(int *row, int i, int first_diagonal, int width, int m, char *y) {
+    if (i == 0) {
+        printf("   |");
+    } else {
+        printf(" %c |", y[i-1]);
+    }
+    for(int j = 0; j<=m; j++) {
+        int t = j - i - first_diagonal;
+        printf("%3d|", t >= 0 && t < width ? row[t] : UNREACHABLE);
+    }
+    printf("\n");
+}
+
+void print_table_row(int *row, int i, int m, char *y) {
+    if (i == 0) {
+        printf("   |");
+    } else {
+        printf(" %c |", y[i-1]);
+    }
+    for(int j = 0; j<=m; j++) {
+        printf("%3d|", row[j]);
+    }
+    printf("\n");
 }
\ No newline at end of file